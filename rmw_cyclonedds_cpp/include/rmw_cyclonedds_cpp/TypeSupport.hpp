@@ -21,6 +21,8 @@
 #include <rosidl_runtime_c/u16string_functions.h>
 
 #include <cassert>
+#include <cstring>
+#include <stdexcept>
 #include <string>
 #include <functional>
 
@@ -78,12 +80,20 @@ struct StringHelper<rosidl_typesupport_introspection_c__MessageMembers>
     return std::string(data.data);
   }
 
+  // Reuses the storage of the string if it is large enough, so that taking into the same message
+  // time and again doesn't touch the heap once it has seen the largest strings
   static void assign(cycdeser & deser, void * field, bool)
   {
-    std::string str;
-    deser >> str;
+    size_t len;
+    const char * str = deser.deserialize_chars(len);
     rosidl_runtime_c__String * c_str = static_cast<rosidl_runtime_c__String *>(field);
-    rosidl_runtime_c__String__assign(c_str, str.c_str());
+    if (c_str->data != nullptr && len < c_str->capacity) {
+      memcpy(c_str->data, str, len);
+      c_str->data[len] = '\0';
+      c_str->size = len;
+    } else if (!rosidl_runtime_c__String__assignn(c_str, str, len)) {
+      throw std::runtime_error("unable to assign rosidl_runtime_c__String");
+    }
   }
 };
 
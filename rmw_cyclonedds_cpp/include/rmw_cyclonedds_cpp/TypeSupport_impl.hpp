@@ -340,9 +340,16 @@ void deserialize_field(
     deser.deserializeA(static_cast<T *>(field), member->array_size_);
   } else {
     auto & data = *reinterpret_cast<typename GenericCSequence<T>::type *>(field);
-    int32_t dsize = 0;
-    deser >> dsize;
-    GenericCSequence<T>::init(&data, dsize);
+    const uint32_t dsize = deser.deserialize_len(sizeof(T));
+    // keep the storage of the sequence if it is large enough
+    if (dsize > data.capacity) {
+      GenericCSequence<T>::fini(&data);
+      if (!GenericCSequence<T>::init(&data, dsize)) {
+        throw std::runtime_error("unable to initialize sequence");
+      }
+    } else {
+      data.size = dsize;
+    }
     deser.deserializeA(reinterpret_cast<T *>(data.data), dsize);
   }
 }
@@ -355,40 +362,31 @@ inline void deserialize_field<std::string>(
   bool call_new)
 {
   (void)call_new;
+  using CStringHelper = StringHelper<rosidl_typesupport_introspection_c__MessageMembers>;
   if (!member->is_array_) {
-    using CStringHelper = StringHelper<rosidl_typesupport_introspection_c__MessageMembers>;
     CStringHelper::assign(deser, field, call_new);
   } else {
     if (member->array_size_ && !member->is_upper_bound_) {
       auto deser_field = static_cast<rosidl_runtime_c__String *>(field);
-      // tmpstring is defined here and not below to avoid
-      // memory allocation in every iteration of the for loop
-      std::string tmpstring;
       for (size_t i = 0; i < member->array_size_; ++i) {
-        deser.deserialize(tmpstring);
-        if (!rosidl_runtime_c__String__assign(&deser_field[i], tmpstring.c_str())) {
-          throw std::runtime_error("unable to assign rosidl_runtime_c__String");
-        }
+        CStringHelper::assign(deser, &deser_field[i], call_new);
       }
     } else {
-      std::vector<std::string> cpp_string_vector;
-      deser >> cpp_string_vector;
-
+      // every string takes at least 4 bytes for its length
+      const uint32_t size = deser.deserialize_len(sizeof(uint32_t));
       auto & string_array_field = *reinterpret_cast<rosidl_runtime_c__String__Sequence *>(field);
-      if (
-        !rosidl_runtime_c__String__Sequence__init(
-          &string_array_field, cpp_string_vector.size()))
-      {
-        throw std::runtime_error("unable to initialize rosidl_runtime_c__String array");
-      }
-
-      for (size_t i = 0; i < cpp_string_vector.size(); ++i) {
-        if (
-          !rosidl_runtime_c__String__assign(
-            &string_array_field.data[i], cpp_string_vector[i].c_str()))
-        {
-          throw std::runtime_error("unable to assign rosidl_runtime_c__String");
+      // the strings beyond the size of the sequence remain initialized up to its capacity, so
+      // they and their storage can be reused
+      if (size > string_array_field.capacity) {
+        rosidl_runtime_c__String__Sequence__fini(&string_array_field);
+        if (!rosidl_runtime_c__String__Sequence__init(&string_array_field, size)) {
+          throw std::runtime_error("unable to initialize rosidl_runtime_c__String array");
         }
+      } else {
+        string_array_field.size = size;
+      }
+      for (size_t i = 0; i < size; ++i) {
+        CStringHelper::assign(deser, &string_array_field.data[i], call_new);
       }
     }
   }
@@ -456,10 +454,22 @@ inline size_t get_submessage_array_deserialize(
   size_t sub_members_size,
   size_t)
 {
-  (void)member;
   uint32_t vsize = deser.deserialize_len(1);
   auto tmparray = static_cast<rosidl_runtime_c__void__Sequence *>(field);
-  rosidl_runtime_c__void__Sequence__init(tmparray, vsize, sub_members_size);
+  if (vsize <= tmparray->capacity) {
+    // the elements up to the capacity are initialized, keep them and their storage
+    tmparray->size = vsize;
+  } else if (member->resize_function != nullptr) {
+    // finalizes the old elements and initializes the new ones
+    if (!member->resize_function(field, vsize)) {
+      throw std::runtime_error("unable to resize sequence");
+    }
+  } else {
+    rosidl_runtime_c__void__Sequence__fini(tmparray);
+    if (!rosidl_runtime_c__void__Sequence__init(tmparray, vsize, sub_members_size)) {
+      throw std::runtime_error("unable to initialize sequence");
+    }
+  }
   subros_message = reinterpret_cast<void *>(tmparray->data);
   return vsize;
 }
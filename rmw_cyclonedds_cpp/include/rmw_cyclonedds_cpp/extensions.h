@@ -0,0 +1,317 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/* Cyclone DDS specific extensions to the RMW API, operating on entities created by this RMW
+   implementation. */
+
+#ifndef RMW_CYCLONEDDS_CPP__EXTENSIONS_H_
+#define RMW_CYCLONEDDS_CPP__EXTENSIONS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rmw/types.h"
+#include "rmw_cyclonedds_cpp/visibility_control.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* What a reliable publisher does when its writer history is full because subscriptions don't
+   acknowledge the data quickly enough, and what any publisher does when it would have to wait
+   for its rate limit (see rmw_cyclonedds_set_publisher_rate_limit) */
+typedef enum rmw_cyclonedds_publish_when_history_full_t
+{
+  /* wait until there is room, however long it takes (the default) */
+  RMW_CYCLONEDDS_PUBLISH_BLOCK,
+  /* wait at most max_blocking_time, then fail with RMW_RET_TIMEOUT */
+  RMW_CYCLONEDDS_PUBLISH_BLOCK_BOUNDED,
+  /* drop the message immediately, publishing it succeeds */
+  RMW_CYCLONEDDS_PUBLISH_DROP
+} rmw_cyclonedds_publish_when_history_full_t;
+
+/* Options for creating a publisher, passed in as the rmw_specific_publisher_payload of the
+   publisher options */
+typedef struct rmw_cyclonedds_publisher_options_t
+{
+  rmw_cyclonedds_publish_when_history_full_t when_history_full;
+  rmw_time_t max_blocking_time;
+} rmw_cyclonedds_publisher_options_t;
+
+typedef struct rmw_cyclonedds_publisher_write_stats_t
+{
+  /* number of messages for which publishing failed with RMW_RET_TIMEOUT */
+  uint64_t would_block;
+  /* number of messages dropped because the writer history was full or because of the rate
+     limit */
+  uint64_t dropped;
+  /* number of messages delayed by the rate limit, and the total and maximum delay */
+  uint64_t shaped;
+  uint64_t shaping_delay_total_ns;
+  uint64_t shaping_delay_max_ns;
+} rmw_cyclonedds_publisher_write_stats_t;
+
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_get_publisher_write_stats(
+  const rmw_publisher_t * publisher,
+  rmw_cyclonedds_publisher_write_stats_t * stats);
+
+/* Pace the writes of a publisher to bytes_per_sec of serialized data on average, allowing
+   bursts of up to burst_bytes.  Only data that goes over the network counts, not data delivered
+   within the process or through shared memory.  Publishing blocks for as long as needed to stay
+   within the limit, a message larger than the burst size is delayed until the bucket has
+   refilled for it, unless the publisher was created with a when_history_full option that bounds
+   or avoids blocking: then a message that would have to wait longer is dropped or publishing it
+   fails with RMW_RET_TIMEOUT.  A rate of 0 removes the limit. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_set_publisher_rate_limit(
+  const rmw_publisher_t * publisher,
+  uint64_t bytes_per_sec,
+  uint64_t burst_bytes);
+
+/* Publish a serialized message without copying it: the publisher takes ownership of the buffer
+   and frees it using the message's allocator once Cyclone no longer needs it.  The buffer must
+   have room for padding the message to a multiple of 4 bytes, else it gets copied after all.
+   Ownership passes to the publisher whether or not publishing succeeds, and serialized_message
+   is left without a buffer. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_publish_serialized_message_adopt(
+  const rmw_publisher_t * publisher,
+  rmw_serialized_message_t * serialized_message);
+
+/* A segment of a serialized message */
+typedef struct rmw_cyclonedds_iovec_t
+{
+  const void * iov_base;
+  size_t iov_len;
+} rmw_cyclonedds_iovec_t;
+
+/* Publish a serialized message given as a list of segments, for example a small serialized
+   header followed by image data in a driver-owned buffer, so that the message need not first
+   be assembled.  The concatenation of the segments must be the complete serialized message,
+   encapsulation header included, as produced by rmw_serialize.  The segments are copied
+   exactly once, into a buffer from the publisher's pool, and may be reused as soon as this
+   returns. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_publish_iovec(
+  const rmw_publisher_t * publisher,
+  const rmw_cyclonedds_iovec_t * iov,
+  size_t iovcnt);
+
+/* Initialize serialized_message with a buffer of at least capacity bytes taken from a pool
+   belonging to the publisher.  Finalizing the message or publishing it using
+   rmw_cyclonedds_publish_serialized_message_adopt returns the buffer to the pool, so that
+   recording or bridging applications can publish without allocating or copying. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_init_pooled_serialized_message(
+  const rmw_publisher_t * publisher,
+  size_t capacity,
+  rmw_serialized_message_t * serialized_message);
+
+/* A serialized message loaned from a subscription, the buffer is read-only and remains valid
+   until the loan is returned.  impl is private to the implementation. */
+typedef struct rmw_cyclonedds_serialized_message_loan_t
+{
+  const uint8_t * buffer;
+  size_t buffer_length;
+  void * impl;
+} rmw_cyclonedds_serialized_message_loan_t;
+
+/* Like rmw_take_serialized_message_with_info, but rather than copying the payload into a
+   serialized message, it returns a loan referencing the received data.  Every loan taken must
+   be returned using rmw_cyclonedds_return_serialized_message_loan. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_take_serialized_message_loan(
+  const rmw_subscription_t * subscription,
+  rmw_cyclonedds_serialized_message_loan_t * loan,
+  bool * taken,
+  rmw_message_info_t * message_info);
+
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_return_serialized_message_loan(
+  const rmw_subscription_t * subscription,
+  rmw_cyclonedds_serialized_message_loan_t * loan);
+
+/* Samples a subscription dropped without deserializing them */
+typedef struct rmw_cyclonedds_subscription_take_stats_t
+{
+  /* superseded by a newer sample in latest-only mode */
+  uint64_t conflated;
+  /* removed by decimation */
+  uint64_t decimated;
+  /* rejected by the content filter */
+  uint64_t filtered;
+  /* repeats suppressed in change-only mode */
+  uint64_t suppressed;
+} rmw_cyclonedds_subscription_take_stats_t;
+
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_get_subscription_take_stats(
+  const rmw_subscription_t * subscription,
+  rmw_cyclonedds_subscription_take_stats_t * stats);
+
+/* In latest-only mode, taking from a subscription takes all samples available when it starts
+   (with a KEEP_ALL history, at most a batch of them) but returns only the newest one, the older
+   ones are dropped without being deserialized.  This suits subscriptions that only need the
+   current state but use a history depth greater than 1 for reliability. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_set_subscription_latest_only(
+  const rmw_subscription_t * subscription,
+  bool enable);
+
+/* Decimate the samples of a subscription, in the spirit of the DDS TIME_BASED_FILTER: only
+   one of every keep_every_n samples is delivered, and only if its source timestamp is at least
+   min_period later than that of the previous sample delivered.  The first sample is always
+   delivered.  Dropped samples are never deserialized.  A period of 0 and keep_every_n of 0 or 1
+   disable decimation. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_set_subscription_decimation(
+  const rmw_subscription_t * subscription,
+  rmw_time_t min_period,
+  uint32_t keep_every_n);
+
+/* In change-only mode, a sample that is identical to the previous one from the same writer is
+   dropped without being deserialized.  Samples are compared by a 64-bit hash of their
+   serialized form, so this is meant for writers repeating messages verbatim, e.g. periodically
+   republished state. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_set_subscription_change_only(
+  const rmw_subscription_t * subscription,
+  bool enable);
+
+/* Filter the samples of a subscription on their contents, in the manner of a DDS
+   content-filtered topic.  The expression compares fields, literals and parameters using =, <>,
+   <, <=, > and >=, combined with AND, OR, NOT and parentheses, e.g.
+   "header.frame_id = 'map' AND (x > %0 OR v[2] <> 0)"; fields must be of primitive or string
+   types, %n is parameters[n], which holds a literal (a bare word is taken as a string).  The
+   filter is evaluated on the serialized sample, rejected samples are never deserialized.  A
+   null or empty expression removes the filter.  Returns RMW_RET_INVALID_ARGUMENT (and sets the
+   error message) if the expression is malformed or doesn't fit the message type. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_set_subscription_content_filter(
+  const rmw_subscription_t * subscription,
+  const char * expression,
+  size_t n_parameters,
+  const char * const * parameters);
+
+/* Enable or disable batching of the writes to a publisher: while enabled, published messages
+   are held back and packed into as few packets as possible until the publisher is flushed,
+   either explicitly or, if max_delay is non-zero, automatically once the oldest of them has
+   been held back for max_delay.  Disabling it flushes the publisher. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_set_publisher_batching(
+  const rmw_publisher_t * publisher,
+  bool enable,
+  rmw_time_t max_delay);
+
+/* Send all messages held back by a batching publisher */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_flush_publisher(const rmw_publisher_t * publisher);
+
+/* Publish count messages in one go, packing them in as few packets as possible.  Stops at the
+   first message that fails to be published; the number published is stored in published if it
+   is not null.  The publisher is flushed afterward unless it is batching. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_publish_many(
+  const rmw_publisher_t * publisher,
+  const void * const * ros_messages,
+  size_t count,
+  size_t * published);
+
+/* Publish ros_message on count publishers of the same type (but typically on different topics),
+   serializing it only once and sharing the serialized form between the writers.  Fails without
+   publishing anything if the publishers are not all of the same type, otherwise stops at the
+   first publisher that fails; the number published to is stored in published if it is not
+   null. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_publish_fanout(
+  const rmw_publisher_t * const * publishers,
+  size_t count,
+  const void * ros_message,
+  size_t * published);
+
+/* A message serialized once for publishing any number of times, see
+   rmw_cyclonedds_prepare_message */
+typedef struct rmw_cyclonedds_prepared_message_t rmw_cyclonedds_prepared_message_t;
+
+/* Serialize ros_message for publishing it repeatedly on publisher, or on other publishers of
+   the same type, for data that gets republished unchanged (static transforms, maps,
+   descriptions).  Publishing a prepared message
+   costs no serialization work, each publication does get a fresh source timestamp.  The
+   message must be destroyed using rmw_cyclonedds_destroy_prepared_message. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_prepare_message(
+  const rmw_publisher_t * publisher,
+  const void * ros_message,
+  rmw_cyclonedds_prepared_message_t ** prepared);
+
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_publish_prepared_message(
+  const rmw_publisher_t * publisher,
+  const rmw_cyclonedds_prepared_message_t * prepared);
+
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_destroy_prepared_message(rmw_cyclonedds_prepared_message_t * prepared);
+
+/* What rmw_publish does with a message when the queue of an asynchronous publisher is full */
+typedef enum rmw_cyclonedds_async_publish_when_full_t
+{
+  /* drop the message and return, counting it in the dropped statistic */
+  RMW_CYCLONEDDS_ASYNC_PUBLISH_DROP_NEWEST,
+  /* wait until the worker has made room for it */
+  RMW_CYCLONEDDS_ASYNC_PUBLISH_BLOCK
+} rmw_cyclonedds_async_publish_when_full_t;
+
+typedef struct rmw_cyclonedds_async_publish_options_t
+{
+  /* number of messages that can be queued, rounded up to a power of 2 */
+  size_t queue_depth;
+  rmw_cyclonedds_async_publish_when_full_t when_full;
+  /* CPU to bind the worker thread to, or -1 to leave it unbound; ignored where unsupported */
+  int worker_cpu;
+} rmw_cyclonedds_async_publish_options_t;
+
+typedef struct rmw_cyclonedds_async_publish_stats_t
+{
+  uint64_t published;
+  /* dropped because the queue was full */
+  uint64_t dropped;
+  /* failed to be copied, serialized or written */
+  uint64_t failed;
+  /* largest number of messages that have been in the queue */
+  size_t high_water_mark;
+  size_t queue_depth;
+} rmw_cyclonedds_async_publish_stats_t;
+
+/* Make rmw_publish asynchronous: it copies the message into a preallocated slot of a queue and
+   returns, while a worker thread belonging to the publisher serializes and writes it.  Passing
+   null for options makes it synchronous again, after the worker has published what is still
+   queued.  Other ways of publishing are not affected. */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_set_publisher_async(
+  const rmw_publisher_t * publisher,
+  const rmw_cyclonedds_async_publish_options_t * options);
+
+/* Statistics of an asynchronous publisher since it was made asynchronous */
+RMW_CYCLONEDDS_CPP_PUBLIC
+rmw_ret_t rmw_cyclonedds_get_publisher_async_stats(
+  const rmw_publisher_t * publisher,
+  rmw_cyclonedds_async_publish_stats_t * stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RMW_CYCLONEDDS_CPP__EXTENSIONS_H_
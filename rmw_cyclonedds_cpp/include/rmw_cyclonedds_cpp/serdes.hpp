@@ -159,18 +159,33 @@ public:
   {
     const uint32_t sz = deserialize_len(sizeof(char));
     if (sz == 0) {
-      x = std::string("");
+      x.clear();
     } else {
       validate_str(sz);
-      x = std::string(data + pos, sz - 1);
+      x.assign(data + pos, sz - 1);
     }
     pos += sz;
   }
+  // Returns the characters of the next string in place, len gets its length excluding the
+  // terminating null
+  inline const char * deserialize_chars(size_t & len)
+  {
+    const uint32_t sz = deserialize_len(sizeof(char));
+    const char * str = data + pos;
+    if (sz == 0) {
+      len = 0;
+    } else {
+      validate_str(sz);
+      len = sz - 1;
+    }
+    pos += sz;
+    return str;
+  }
   inline void deserialize(std::wstring & x)
   {
     const uint32_t sz = deserialize_len(sizeof(wchar_t));
     // wstring is not null-terminated in cdr
-    x = std::wstring(reinterpret_cast<const wchar_t *>(data + pos), sz);
+    x.assign(reinterpret_cast<const wchar_t *>(data + pos), sz);
     pos += sz * sizeof(wchar_t);
   }
 
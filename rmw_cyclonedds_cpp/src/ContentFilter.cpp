@@ -0,0 +1,950 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "ContentFilter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bytewise.hpp"
+
+namespace rmw_cyclonedds_cpp
+{
+
+namespace
+{
+
+/// Thrown when the serialized data ends prematurely
+struct DecodeError
+{
+};
+
+// Sizes of primitives in CDR, matching CDRWriter; they are aligned to their size, up to 8
+size_t cdr_size_of_primitive(ROSIDL_TypeKind tk)
+{
+  switch (tk) {
+    case ROSIDL_TypeKind::BOOLEAN:
+    case ROSIDL_TypeKind::OCTET:
+    case ROSIDL_TypeKind::UINT8:
+    case ROSIDL_TypeKind::INT8:
+    case ROSIDL_TypeKind::CHAR:
+      return 1;
+    case ROSIDL_TypeKind::UINT16:
+    case ROSIDL_TypeKind::INT16:
+    case ROSIDL_TypeKind::WCHAR:
+      return 2;
+    case ROSIDL_TypeKind::UINT32:
+    case ROSIDL_TypeKind::INT32:
+    case ROSIDL_TypeKind::FLOAT:
+      return 4;
+    case ROSIDL_TypeKind::UINT64:
+    case ROSIDL_TypeKind::INT64:
+    case ROSIDL_TypeKind::DOUBLE:
+      return 8;
+    case ROSIDL_TypeKind::LONG_DOUBLE:
+      return 16;
+    case ROSIDL_TypeKind::STRING:
+    case ROSIDL_TypeKind::WSTRING:
+    case ROSIDL_TypeKind::MESSAGE:
+    default:
+      unreachable();
+  }
+}
+
+size_t cdr_align_of_primitive(ROSIDL_TypeKind tk)
+{
+  return std::min(cdr_size_of_primitive(tk), size_t{8});
+}
+
+/// Reads serialized data, checking every access against the end of the data
+class CDRReader
+{
+  const byte * m_data;
+  size_t m_size;
+  size_t m_pos;
+  bool m_swap;
+
+public:
+  CDRReader(const byte * data, size_t size, bool swap)
+  : m_data{data}, m_size{size}, m_pos{0}, m_swap{swap}
+  {
+  }
+
+  size_t position() const {return m_pos;}
+
+  void align(size_t n_bytes)
+  {
+    advance((n_bytes - m_pos % n_bytes) % n_bytes);
+  }
+
+  void advance(size_t n_bytes)
+  {
+    if (n_bytes > m_size - m_pos) {
+      throw DecodeError();
+    }
+    m_pos += n_bytes;
+  }
+
+  const byte * take(size_t n_bytes)
+  {
+    const byte * p = m_data + m_pos;
+    advance(n_bytes);
+    return p;
+  }
+
+  template<typename T>
+  T read()
+  {
+    align(std::min(sizeof(T), size_t{8}));
+    T value;
+    byte raw[sizeof(T)];
+    std::memcpy(raw, take(sizeof(T)), sizeof(T));
+    if (m_swap) {
+      std::reverse(raw, raw + sizeof(T));
+    }
+    std::memcpy(&value, raw, sizeof(T));
+    return value;
+  }
+};
+
+void skip(CDRReader & reader, const AnyValueType * value_type);
+
+void skip_many(CDRReader & reader, const AnyValueType * value_type, size_t count)
+{
+  if (count == 0) {
+    return;
+  }
+  if (value_type->e_value_type() == EValueType::PrimitiveValueType) {
+    auto tk = static_cast<const PrimitiveValueType *>(value_type)->type_kind();
+    const size_t size = cdr_size_of_primitive(tk);
+    reader.align(cdr_align_of_primitive(tk));
+    if (count > std::numeric_limits<size_t>::max() / size) {
+      throw DecodeError();
+    }
+    reader.advance(count * size);
+    return;
+  }
+  const size_t start = reader.position();
+  skip(reader, value_type);
+  if (reader.position() == start) {
+    // elements without any data, e.g. structs without members
+    return;
+  }
+  for (size_t i = 1; i < count; i++) {
+    skip(reader, value_type);
+  }
+}
+
+void skip(CDRReader & reader, const AnyValueType * value_type)
+{
+  switch (value_type->e_value_type()) {
+    case EValueType::PrimitiveValueType:
+      skip_many(reader, value_type, 1);
+      break;
+    case EValueType::U8StringValueType:
+      reader.advance(reader.read<uint32_t>());
+      break;
+    case EValueType::U16StringValueType:
+      // CDRWriter writes a wchar_t per character
+      reader.advance(size_t{reader.read<uint32_t>()} * sizeof(wchar_t));
+      break;
+    case EValueType::StructValueType: {
+        auto st = static_cast<const StructValueType *>(value_type);
+        for (size_t i = 0; i < st->n_members(); i++) {
+          skip(reader, st->get_member(i)->value_type);
+        }
+      }
+      break;
+    case EValueType::ArrayValueType: {
+        auto at = static_cast<const ArrayValueType *>(value_type);
+        skip_many(reader, at->element_value_type(), at->array_size());
+      }
+      break;
+    case EValueType::SpanSequenceValueType: {
+        auto st = static_cast<const SpanSequenceValueType *>(value_type);
+        skip_many(reader, st->element_value_type(), reader.read<uint32_t>());
+      }
+      break;
+    case EValueType::BoolVectorValueType:
+      reader.advance(reader.read<uint32_t>());
+      break;
+    default:
+      unreachable();
+  }
+}
+
+/// A value of a field or a literal, string values reference the data they come from
+struct Value
+{
+  enum class Kind
+  {
+    Signed,
+    Unsigned,
+    Float,
+    String,
+  };
+  Kind kind;
+  int64_t i;
+  uint64_t u;
+  double f;
+  const char * str;
+  size_t len;
+
+  static Value of_signed(int64_t x)
+  {
+    Value v{Kind::Signed, x, 0, 0.0, nullptr, 0};
+    return v;
+  }
+  static Value of_unsigned(uint64_t x)
+  {
+    Value v{Kind::Unsigned, 0, x, 0.0, nullptr, 0};
+    return v;
+  }
+  static Value of_float(double x)
+  {
+    Value v{Kind::Float, 0, 0, x, nullptr, 0};
+    return v;
+  }
+  static Value of_string(const char * s, size_t n)
+  {
+    Value v{Kind::String, 0, 0, 0.0, s, n};
+    return v;
+  }
+
+  double as_double() const
+  {
+    switch (kind) {
+      case Kind::Signed:
+        return static_cast<double>(i);
+      case Kind::Unsigned:
+        return static_cast<double>(u);
+      case Kind::Float:
+        return f;
+      case Kind::String:
+      default:
+        unreachable();
+    }
+  }
+};
+
+Value::Kind kind_of_primitive(ROSIDL_TypeKind tk)
+{
+  switch (tk) {
+    case ROSIDL_TypeKind::FLOAT:
+    case ROSIDL_TypeKind::DOUBLE:
+    case ROSIDL_TypeKind::LONG_DOUBLE:
+      return Value::Kind::Float;
+    case ROSIDL_TypeKind::INT8:
+    case ROSIDL_TypeKind::INT16:
+    case ROSIDL_TypeKind::INT32:
+    case ROSIDL_TypeKind::INT64:
+      return Value::Kind::Signed;
+    default:
+      return Value::Kind::Unsigned;
+  }
+}
+
+Value read_primitive(CDRReader & reader, ROSIDL_TypeKind tk)
+{
+  switch (tk) {
+    case ROSIDL_TypeKind::BOOLEAN:
+      return Value::of_unsigned(reader.read<uint8_t>() != 0);
+    case ROSIDL_TypeKind::OCTET:
+    case ROSIDL_TypeKind::UINT8:
+    case ROSIDL_TypeKind::CHAR:
+      return Value::of_unsigned(reader.read<uint8_t>());
+    case ROSIDL_TypeKind::INT8:
+      return Value::of_signed(reader.read<int8_t>());
+    case ROSIDL_TypeKind::UINT16:
+    case ROSIDL_TypeKind::WCHAR:
+      return Value::of_unsigned(reader.read<uint16_t>());
+    case ROSIDL_TypeKind::INT16:
+      return Value::of_signed(reader.read<int16_t>());
+    case ROSIDL_TypeKind::UINT32:
+      return Value::of_unsigned(reader.read<uint32_t>());
+    case ROSIDL_TypeKind::INT32:
+      return Value::of_signed(reader.read<int32_t>());
+    case ROSIDL_TypeKind::UINT64:
+      return Value::of_unsigned(reader.read<uint64_t>());
+    case ROSIDL_TypeKind::INT64:
+      return Value::of_signed(reader.read<int64_t>());
+    case ROSIDL_TypeKind::FLOAT:
+      return Value::of_float(reader.read<float>());
+    case ROSIDL_TypeKind::DOUBLE:
+      return Value::of_float(reader.read<double>());
+    case ROSIDL_TypeKind::LONG_DOUBLE: {
+        // CDRWriter copies the in-memory representation, which is only meaningful if it is 16
+        // bytes and needs no swapping
+        reader.align(8);
+        const byte * raw = reader.take(16);
+        long double x;
+        static_assert(sizeof(x) <= 16, "long double larger than its CDR representation");
+        std::memcpy(&x, raw, sizeof(x));
+        return Value::of_float(static_cast<double>(x));
+      }
+    case ROSIDL_TypeKind::STRING:
+    case ROSIDL_TypeKind::WSTRING:
+    case ROSIDL_TypeKind::MESSAGE:
+    default:
+      unreachable();
+  }
+}
+
+/// One step along the path to a field: a member of a struct, or an element of an array or
+/// sequence
+struct PathStep
+{
+  const AnyValueType * container;
+  size_t index;
+};
+
+/// An operand of a comparison, either a field or a literal
+class Operand
+{
+  std::vector<PathStep> m_path;
+  const AnyValueType * m_field_type;
+  Value m_literal;
+  std::string m_literal_string;
+
+public:
+  Operand(std::vector<PathStep> path, const AnyValueType * field_type)
+  : m_path{std::move(path)}, m_field_type{field_type}, m_literal{}
+  {
+  }
+
+  explicit Operand(Value literal)
+  : m_field_type{nullptr}, m_literal{literal}
+  {
+  }
+
+  explicit Operand(std::string literal)
+  : m_field_type{nullptr}, m_literal{Value::of_string(nullptr, 0)},
+    m_literal_string{std::move(literal)}
+  {
+  }
+
+  Value::Kind kind() const
+  {
+    if (m_field_type == nullptr) {
+      return m_literal.kind;
+    } else if (m_field_type->e_value_type() == EValueType::U8StringValueType) {
+      return Value::Kind::String;
+    } else {
+      return kind_of_primitive(static_cast<const PrimitiveValueType *>(m_field_type)->type_kind());
+    }
+  }
+
+  /// Gets the value for the message in reader, returning false if the field doesn't exist
+  /// because an index is beyond the end of a sequence
+  bool get(CDRReader reader, Value & value) const
+  {
+    if (m_field_type == nullptr) {
+      value = m_literal;
+      if (value.kind == Value::Kind::String) {
+        value.str = m_literal_string.data();
+        value.len = m_literal_string.size();
+      }
+      return true;
+    }
+    for (const auto & step : m_path) {
+      switch (step.container->e_value_type()) {
+        case EValueType::StructValueType: {
+            auto st = static_cast<const StructValueType *>(step.container);
+            for (size_t i = 0; i < step.index; i++) {
+              skip(reader, st->get_member(i)->value_type);
+            }
+          }
+          break;
+        case EValueType::ArrayValueType: {
+            auto at = static_cast<const ArrayValueType *>(step.container);
+            skip_many(reader, at->element_value_type(), step.index);
+          }
+          break;
+        case EValueType::SpanSequenceValueType: {
+            auto st = static_cast<const SpanSequenceValueType *>(step.container);
+            if (step.index >= reader.read<uint32_t>()) {
+              return false;
+            }
+            skip_many(reader, st->element_value_type(), step.index);
+          }
+          break;
+        case EValueType::BoolVectorValueType:
+          if (step.index >= reader.read<uint32_t>()) {
+            return false;
+          }
+          reader.advance(step.index);
+          break;
+        default:
+          unreachable();
+      }
+    }
+    if (m_field_type->e_value_type() == EValueType::U8StringValueType) {
+      size_t len = reader.read<uint32_t>();
+      auto str = reinterpret_cast<const char *>(reader.take(len));
+      // the length includes the terminating 0
+      if (len > 0 && str[len - 1] == '\0') {
+        len--;
+      }
+      value = Value::of_string(str, len);
+    } else {
+      auto pt = static_cast<const PrimitiveValueType *>(m_field_type);
+      value = read_primitive(reader, pt->type_kind());
+    }
+    return true;
+  }
+};
+
+enum class Relation
+{
+  EQ, NE, LT, LE, GT, GE
+};
+
+class Expr
+{
+public:
+  virtual bool eval(const CDRReader & reader) const = 0;
+  virtual ~Expr() = default;
+};
+
+class Comparison : public Expr
+{
+  Operand m_lhs;
+  Relation m_rel;
+  Operand m_rhs;
+
+  /// Three-way comparison, false if the values are incomparable (NaN)
+  static bool compare(const Value & a, const Value & b, int & result)
+  {
+    using Kind = Value::Kind;
+    if (a.kind == Kind::String) {
+      const int c = std::memcmp(a.str, b.str, std::min(a.len, b.len));
+      result = (c != 0) ? c : (a.len < b.len) ? -1 : (a.len > b.len) ? 1 : 0;
+    } else if (a.kind == Kind::Float || b.kind == Kind::Float) {
+      const double x = a.as_double(), y = b.as_double();
+      if (x != x || y != y) {
+        return false;
+      }
+      result = (x < y) ? -1 : (x > y) ? 1 : 0;
+    } else if (a.kind == Kind::Signed && b.kind == Kind::Signed) {
+      result = (a.i < b.i) ? -1 : (a.i > b.i) ? 1 : 0;
+    } else if (a.kind == Kind::Unsigned && b.kind == Kind::Unsigned) {
+      result = (a.u < b.u) ? -1 : (a.u > b.u) ? 1 : 0;
+    } else if (a.kind == Kind::Signed) {
+      result = (a.i < 0 || static_cast<uint64_t>(a.i) < b.u) ? -1 :
+        (static_cast<uint64_t>(a.i) > b.u) ? 1 : 0;
+    } else {
+      result = (b.i < 0 || a.u > static_cast<uint64_t>(b.i)) ? 1 :
+        (a.u < static_cast<uint64_t>(b.i)) ? -1 : 0;
+    }
+    return true;
+  }
+
+public:
+  Comparison(Operand lhs, Relation rel, Operand rhs)
+  : m_lhs{std::move(lhs)}, m_rel{rel}, m_rhs{std::move(rhs)}
+  {
+  }
+
+  bool eval(const CDRReader & reader) const override
+  {
+    Value a, b;
+    int c;
+    if (!m_lhs.get(reader, a) || !m_rhs.get(reader, b) || !compare(a, b, c)) {
+      return false;
+    }
+    switch (m_rel) {
+      case Relation::EQ:
+        return c == 0;
+      case Relation::NE:
+        return c != 0;
+      case Relation::LT:
+        return c < 0;
+      case Relation::LE:
+        return c <= 0;
+      case Relation::GT:
+        return c > 0;
+      case Relation::GE:
+        return c >= 0;
+      default:
+        unreachable();
+    }
+  }
+};
+
+class Conjunction : public Expr
+{
+  std::unique_ptr<Expr> m_lhs, m_rhs;
+  bool m_is_and;
+
+public:
+  Conjunction(std::unique_ptr<Expr> lhs, std::unique_ptr<Expr> rhs, bool is_and)
+  : m_lhs{std::move(lhs)}, m_rhs{std::move(rhs)}, m_is_and{is_and}
+  {
+  }
+
+  bool eval(const CDRReader & reader) const override
+  {
+    return m_is_and ?
+           (m_lhs->eval(reader) && m_rhs->eval(reader)) :
+           (m_lhs->eval(reader) || m_rhs->eval(reader));
+  }
+};
+
+class Negation : public Expr
+{
+  std::unique_ptr<Expr> m_expr;
+
+public:
+  explicit Negation(std::unique_ptr<Expr> expr)
+  : m_expr{std::move(expr)}
+  {
+  }
+
+  bool eval(const CDRReader & reader) const override {return !m_expr->eval(reader);}
+};
+
+struct Token
+{
+  enum class Kind
+  {
+    Ident,
+    Number,
+    String,
+    Param,
+    Symbol,
+    End,
+  };
+  Kind kind;
+  std::string text;
+};
+
+std::vector<Token> tokenize(const std::string & s)
+{
+  std::vector<Token> tokens;
+  size_t i = 0;
+  auto isdigit = [](char c) {return std::isdigit(static_cast<unsigned char>(c)) != 0;};
+  auto isalpha = [](char c) {return std::isalpha(static_cast<unsigned char>(c)) != 0;};
+  while (i < s.size()) {
+    const char c = s[i];
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      i++;
+    } else if (isalpha(c) || c == '_') {
+      size_t j = i + 1;
+      while (j < s.size() && (isalpha(s[j]) || isdigit(s[j]) || s[j] == '_')) {
+        j++;
+      }
+      tokens.push_back({Token::Kind::Ident, s.substr(i, j - i)});
+      i = j;
+    } else if (isdigit(c) || (c == '.' && i + 1 < s.size() && isdigit(s[i + 1]))) {
+      size_t j = i;
+      while (j < s.size() && (isdigit(s[j]) || s[j] == '.')) {
+        j++;
+      }
+      if (j < s.size() && (s[j] == 'e' || s[j] == 'E')) {
+        j++;
+        if (j < s.size() && (s[j] == '+' || s[j] == '-')) {
+          j++;
+        }
+        while (j < s.size() && isdigit(s[j])) {
+          j++;
+        }
+      }
+      tokens.push_back({Token::Kind::Number, s.substr(i, j - i)});
+      i = j;
+    } else if (c == '\'') {
+      std::string str;
+      size_t j = i + 1;
+      for (;; j++) {
+        if (j == s.size()) {
+          throw std::invalid_argument("unterminated string in filter expression");
+        } else if (s[j] == '\'' && j + 1 < s.size() && s[j + 1] == '\'') {
+          str.push_back('\'');
+          j++;
+        } else if (s[j] == '\'') {
+          break;
+        } else {
+          str.push_back(s[j]);
+        }
+      }
+      tokens.push_back({Token::Kind::String, str});
+      i = j + 1;
+    } else if (c == '%') {
+      size_t j = i + 1;
+      while (j < s.size() && isdigit(s[j])) {
+        j++;
+      }
+      if (j == i + 1) {
+        throw std::invalid_argument("parameter number missing after % in filter expression");
+      }
+      tokens.push_back({Token::Kind::Param, s.substr(i + 1, j - i - 1)});
+      i = j;
+    } else {
+      static const char * const symbols[] = {
+        "<=", ">=", "<>", "!=", "==", "=", "<", ">", "(", ")", ".", "[", "]", "-"
+      };
+      const char * sym = nullptr;
+      for (auto x : symbols) {
+        if (s.compare(i, strlen(x), x) == 0) {
+          sym = x;
+          break;
+        }
+      }
+      if (sym == nullptr) {
+        throw std::invalid_argument(
+                std::string("unexpected character '") + c + "' in filter expression");
+      }
+      tokens.push_back({Token::Kind::Symbol, sym});
+      i += strlen(sym);
+    }
+  }
+  tokens.push_back({Token::Kind::End, ""});
+  return tokens;
+}
+
+bool is_keyword(const Token & t, const char * keyword)
+{
+  if (t.kind != Token::Kind::Ident || t.text.size() != strlen(keyword)) {
+    return false;
+  }
+  for (size_t i = 0; i < t.text.size(); i++) {
+    if (std::toupper(static_cast<unsigned char>(t.text[i])) != keyword[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// The literal a number token denotes, negated if negative is set
+Value parse_number(const std::string & text, bool negative)
+{
+  const bool is_float = text.find_first_of(".eE") != std::string::npos;
+  char * end;
+  errno = 0;
+  Value v;
+  if (is_float) {
+    const double x = std::strtod(text.c_str(), &end);
+    v = Value::of_float(negative ? -x : x);
+  } else {
+    const unsigned long long x = std::strtoull(text.c_str(), &end, 10);  // NOLINT
+    if (negative) {
+      if (x > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + 1) {
+        errno = ERANGE;
+      }
+      v = Value::of_signed(static_cast<int64_t>(0 - static_cast<uint64_t>(x)));
+    } else {
+      v = Value::of_unsigned(x);
+    }
+  }
+  if (*end != '\0' || errno == ERANGE) {
+    throw std::invalid_argument("invalid number '" + text + "' in filter expression");
+  }
+  return v;
+}
+
+class Parser
+{
+  const StructValueType * m_root;
+  const std::vector<std::string> & m_parameters;
+  std::vector<Token> m_tokens;
+  size_t m_pos;
+
+  const Token & peek() const {return m_tokens[m_pos];}
+  const Token & next() {return m_tokens[m_pos++];}
+
+  bool accept_symbol(const char * sym)
+  {
+    if (peek().kind == Token::Kind::Symbol && peek().text == sym) {
+      m_pos++;
+      return true;
+    }
+    return false;
+  }
+
+  bool accept_keyword(const char * keyword)
+  {
+    if (is_keyword(peek(), keyword)) {
+      m_pos++;
+      return true;
+    }
+    return false;
+  }
+
+  [[noreturn]] void error(const std::string & what) const
+  {
+    const Token & t = peek();
+    throw std::invalid_argument(
+            what + " at " + ((t.kind == Token::Kind::End) ? "end" : "'" + t.text + "'") +
+            " in filter expression");
+  }
+
+  std::unique_ptr<Expr> parse_or()
+  {
+    auto lhs = parse_and();
+    while (accept_keyword("OR")) {
+      lhs = std::make_unique<Conjunction>(std::move(lhs), parse_and(), false);
+    }
+    return lhs;
+  }
+
+  std::unique_ptr<Expr> parse_and()
+  {
+    auto lhs = parse_not();
+    while (accept_keyword("AND")) {
+      lhs = std::make_unique<Conjunction>(std::move(lhs), parse_not(), true);
+    }
+    return lhs;
+  }
+
+  std::unique_ptr<Expr> parse_not()
+  {
+    if (accept_keyword("NOT")) {
+      return std::make_unique<Negation>(parse_not());
+    }
+    return parse_comparison();
+  }
+
+  std::unique_ptr<Expr> parse_comparison()
+  {
+    if (accept_symbol("(")) {
+      auto e = parse_or();
+      if (!accept_symbol(")")) {
+        error("')' expected");
+      }
+      return e;
+    }
+    Operand lhs = parse_operand();
+    Relation rel;
+    if (accept_symbol("=") || accept_symbol("==")) {
+      rel = Relation::EQ;
+    } else if (accept_symbol("<>") || accept_symbol("!=")) {
+      rel = Relation::NE;
+    } else if (accept_symbol("<")) {
+      rel = Relation::LT;
+    } else if (accept_symbol("<=")) {
+      rel = Relation::LE;
+    } else if (accept_symbol(">")) {
+      rel = Relation::GT;
+    } else if (accept_symbol(">=")) {
+      rel = Relation::GE;
+    } else {
+      error("comparison operator expected");
+    }
+    Operand rhs = parse_operand();
+    if ((lhs.kind() == Value::Kind::String) != (rhs.kind() == Value::Kind::String)) {
+      error("comparison of a string with a number");
+    }
+    return std::make_unique<Comparison>(std::move(lhs), rel, std::move(rhs));
+  }
+
+  Operand parse_operand()
+  {
+    const Token & t = peek();
+    if (t.kind == Token::Kind::Param) {
+      m_pos++;
+      const size_t index = std::strtoul(t.text.c_str(), nullptr, 10);
+      if (index >= m_parameters.size()) {
+        throw std::invalid_argument("filter expression refers to missing parameter %" + t.text);
+      }
+      return parse_parameter(m_parameters[index]);
+    } else if (t.kind == Token::Kind::String) {
+      m_pos++;
+      return Operand(t.text);
+    } else if (t.kind == Token::Kind::Number) {
+      m_pos++;
+      return Operand(parse_number(t.text, false));
+    } else if (t.kind == Token::Kind::Symbol && t.text == "-") {
+      m_pos++;
+      if (peek().kind != Token::Kind::Number) {
+        error("number expected");
+      }
+      return Operand(parse_number(next().text, true));
+    } else if (accept_keyword("TRUE")) {
+      return Operand(Value::of_unsigned(1));
+    } else if (accept_keyword("FALSE")) {
+      return Operand(Value::of_unsigned(0));
+    } else if (t.kind == Token::Kind::Ident) {
+      return parse_field();
+    } else {
+      error("field or literal expected");
+    }
+  }
+
+  static Operand parse_parameter(const std::string & text)
+  {
+    std::vector<Token> tokens;
+    try {
+      tokens = tokenize(text);
+    } catch (std::invalid_argument &) {
+      return Operand(text);
+    }
+    using Kind = Token::Kind;
+    if (tokens.size() == 2 && tokens[0].kind == Kind::Number) {
+      return Operand(parse_number(tokens[0].text, false));
+    } else if (tokens.size() == 3 && tokens[0].kind == Kind::Symbol && tokens[0].text == "-" &&
+      tokens[1].kind == Kind::Number)
+    {
+      return Operand(parse_number(tokens[1].text, true));
+    } else if (tokens.size() == 2 && tokens[0].kind == Kind::String) {
+      return Operand(tokens[0].text);
+    } else if (tokens.size() == 2 && is_keyword(tokens[0], "TRUE")) {
+      return Operand(Value::of_unsigned(1));
+    } else if (tokens.size() == 2 && is_keyword(tokens[0], "FALSE")) {
+      return Operand(Value::of_unsigned(0));
+    } else {
+      return Operand(text);
+    }
+  }
+
+  Operand parse_field()
+  {
+    std::vector<PathStep> path;
+    const AnyValueType * type = m_root;
+    std::string name;
+    bool member = true;
+    for (;; ) {
+      if (member) {
+        if (type->e_value_type() != EValueType::StructValueType) {
+          error("'" + name + "' has no members");
+        }
+        if (peek().kind != Token::Kind::Ident) {
+          error("field name expected");
+        }
+        auto st = static_cast<const StructValueType *>(type);
+        const std::string & member_name = next().text;
+        size_t i;
+        for (i = 0; i < st->n_members(); i++) {
+          if (member_name == st->get_member(i)->name) {
+            break;
+          }
+        }
+        if (i == st->n_members()) {
+          throw std::invalid_argument("no field '" + member_name + "' in filter expression");
+        }
+        name += (name.empty() ? "" : ".") + member_name;
+        path.push_back({type, i});
+        type = st->get_member(i)->value_type;
+      } else {
+        if (peek().kind != Token::Kind::Number) {
+          error("index expected");
+        }
+        const Value index = parse_number(next().text, false);
+        if (index.kind != Value::Kind::Unsigned || !accept_symbol("]")) {
+          error("']' expected");
+        }
+        switch (type->e_value_type()) {
+          case EValueType::ArrayValueType: {
+              auto at = static_cast<const ArrayValueType *>(type);
+              if (index.u >= at->array_size()) {
+                error("index out of bounds");
+              }
+              path.push_back({type, static_cast<size_t>(index.u)});
+              type = at->element_value_type();
+            }
+            break;
+          case EValueType::SpanSequenceValueType:
+            path.push_back({type, static_cast<size_t>(index.u)});
+            type = static_cast<const SpanSequenceValueType *>(type)->element_value_type();
+            break;
+          case EValueType::BoolVectorValueType:
+            path.push_back({type, static_cast<size_t>(index.u)});
+            type = BoolVectorValueType::element_value_type();
+            break;
+          default:
+            error("'" + name + "' is not an array or sequence");
+        }
+        name += "[" + std::to_string(index.u) + "]";
+      }
+      if (accept_symbol(".")) {
+        member = true;
+      } else if (accept_symbol("[")) {
+        member = false;
+      } else {
+        break;
+      }
+    }
+    if (type->e_value_type() != EValueType::PrimitiveValueType &&
+      type->e_value_type() != EValueType::U8StringValueType)
+    {
+      throw std::invalid_argument(
+              "field '" + name + "' in filter expression is not of a primitive or string type");
+    }
+    return Operand(std::move(path), type);
+  }
+
+public:
+  Parser(
+    const StructValueType * root, const std::string & expression,
+    const std::vector<std::string> & parameters)
+  : m_root{root}, m_parameters{parameters}, m_tokens{tokenize(expression)}, m_pos{0}
+  {
+  }
+
+  std::unique_ptr<Expr> parse()
+  {
+    auto e = parse_or();
+    if (peek().kind != Token::Kind::End) {
+      error("end of expression expected");
+    }
+    return e;
+  }
+};
+
+class CompiledContentFilter : public ContentFilter
+{
+  std::unique_ptr<Expr> m_expr;
+
+public:
+  explicit CompiledContentFilter(std::unique_ptr<Expr> expr)
+  : m_expr{std::move(expr)}
+  {
+  }
+
+  bool matches(const void * payload, size_t size) const override
+  {
+    // only plain CDR is supported, which is all CDRWriter produces
+    auto hdr = static_cast<const unsigned char *>(payload);
+    if (size < 4 || hdr[0] != 0 || hdr[1] > 1) {
+      return false;
+    }
+    const bool little = (hdr[1] == 1);
+    const bool swap = (little != (native_endian() == endian::little));
+    CDRReader reader(static_cast<const byte *>(payload) + 4, size - 4, swap);
+    try {
+      return m_expr->eval(reader);
+    } catch (DecodeError &) {
+      return false;
+    }
+  }
+};
+
+}  // namespace
+
+std::unique_ptr<ContentFilter> ContentFilter::compile(
+  const StructValueType * value_type, const std::string & expression,
+  const std::vector<std::string> & parameters)
+{
+  Parser parser(value_type, expression, parameters);
+  return std::make_unique<CompiledContentFilter>(parser.parse());
+}
+
+}  // namespace rmw_cyclonedds_cpp
@@ -0,0 +1,54 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTENTFILTER_HPP_
+#define CONTENTFILTER_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TypeSupport2.hpp"
+
+namespace rmw_cyclonedds_cpp
+{
+
+/// A filter on the contents of messages, evaluated on their serialized (CDR) form so that
+/// messages it rejects are never deserialized.
+///
+/// The expression language is a subset of that of DDS content-filtered topics: comparisons
+/// (=, <>, <, <=, >, >=) of fields, literals and parameters, combined using AND, OR, NOT and
+/// parentheses.  A field is named by its path in the message, e.g. "header.frame_id" or
+/// "position[2]"; it must be of a primitive or string type.  Literals are integers,
+/// floating-point numbers, strings in single quotes and TRUE and FALSE.  Parameter %n is
+/// replaced by the literal in parameters[n], a bare word there is taken as a string.
+///
+/// A comparison involving an element beyond the end of a sequence is false.
+class ContentFilter
+{
+public:
+  /// Compile expression for messages of type value_type.  Throws std::invalid_argument if the
+  /// expression is malformed or doesn't fit the type.
+  static std::unique_ptr<ContentFilter> compile(
+    const StructValueType * value_type, const std::string & expression,
+    const std::vector<std::string> & parameters);
+
+  /// Whether a serialized message, including encapsulation header, passes the filter; a
+  /// message that can't be decoded doesn't
+  virtual bool matches(const void * payload, size_t size) const = 0;
+  virtual ~ContentFilter() = default;
+};
+
+}  // namespace rmw_cyclonedds_cpp
+
+#endif  // CONTENTFILTER_HPP_
@@ -0,0 +1,670 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "DeepCopy.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rmw_cyclonedds_cpp
+{
+
+/// Encapsulation identifier of the native flat representation, from the range reserved for
+/// vendor-specific representations
+static const uint8_t flat_encoding[2] = {0x80, 0x4e};
+
+bool is_flat_payload(const void * payload, size_t size)
+{
+  return size >= 4 && memcmp(payload, flat_encoding, 2) == 0;
+}
+
+/// Appends to the native flat representation, or if constructed without a buffer, only
+/// computes its size
+class FlatWriter
+{
+  byte * m_dst;
+  size_t m_pos = 0;
+
+public:
+  explicit FlatWriter(void * dst)
+  : m_dst{static_cast<byte *>(dst)} {}
+
+  size_t pos() const {return m_pos;}
+
+  /// Returns where the data went, or null if only computing the size
+  byte * put(const void * src, size_t size)
+  {
+    size_t pad = (0 - m_pos) % 8;
+    byte * dst = nullptr;
+    if (m_dst) {
+      std::memset(m_dst + m_pos, 0, pad);
+      dst = m_dst + m_pos + pad;
+      if (size > 0) {
+        std::memcpy(dst, src, size);
+      }
+    }
+    m_pos += pad + size;
+    return dst;
+  }
+
+  void put_count(uint64_t count) {put(&count, sizeof(count));}
+};
+
+/// Reads the native flat representation, checking every access against its size
+class FlatReader
+{
+  const byte * m_src;
+  size_t m_size;
+  size_t m_pos = 0;
+
+public:
+  FlatReader(const void * src, size_t size)
+  : m_src{static_cast<const byte *>(src)}, m_size{size} {}
+
+  const void * get(size_t size)
+  {
+    size_t start = m_pos + (0 - m_pos) % 8;
+    if (start > m_size || size > m_size - start) {
+      throw std::runtime_error("native flat representation is truncated");
+    }
+    m_pos = start + size;
+    return m_src + start;
+  }
+
+  /// the length of a string or sequence whose elements take at least min_element_size bytes
+  size_t get_count(size_t min_element_size)
+  {
+    uint64_t count;
+    std::memcpy(&count, get(sizeof(count)), sizeof(count));
+    if (min_element_size > 0 && count > (m_size - m_pos) / min_element_size) {
+      throw std::runtime_error("native flat representation is truncated");
+    }
+    return static_cast<size_t>(count);
+  }
+};
+
+class DeepCopier : public BaseDeepCopier
+{
+  /// A range of padding bytes, relative to the start of a value or a copy step
+  struct Hole
+  {
+    size_t offset;
+    size_t size;
+  };
+
+  /// One step in copying a struct: either a memcpy of a region holding only plain data (which
+  /// may span several members) or a copy of a single member that owns storage
+  struct CopyStep
+  {
+    size_t offset;
+    size_t size;
+    /// null for a memcpy
+    const AnyValueType * value_type;
+    /// padding within a memcpy, which must not end up in the flat representation
+    std::vector<Hole> holes;
+  };
+
+  const StructValueType * m_root_value_type;
+  /// whether a type can be copied with memcpy
+  std::unordered_map<const AnyValueType *, bool> plain_cache;
+  /// padding within each plain type
+  std::unordered_map<const AnyValueType *, std::vector<Hole>> plain_holes;
+  std::unordered_map<const StructValueType *, std::vector<CopyStep>> struct_steps;
+  uint64_t m_layout_hash;
+
+public:
+  explicit DeepCopier(const StructValueType * root_value_type)
+  : m_root_value_type{root_value_type}
+  {
+    assert(m_root_value_type);
+    register_type(m_root_value_type);
+    std::string layout;
+    const uint16_t one = 1;
+    layout.push_back(*reinterpret_cast<const char *>(&one) ? 'l' : 'b');
+    describe_layout(layout, m_root_value_type);
+    // FNV-1a
+    m_layout_hash = 14695981039346656037ull;
+    for (char c : layout) {
+      m_layout_hash = (m_layout_hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+  }
+
+  void copy(void * dst, const void * src) const override
+  {
+    copy_struct(dst, src, m_root_value_type);
+  }
+
+  void * make_message() const override
+  {
+    void * message = std::malloc(std::max(m_root_value_type->sizeof_struct(), size_t(1)));
+    if (message == nullptr) {
+      throw std::bad_alloc();
+    }
+    try {
+      m_root_value_type->init_message(message);
+    } catch (...) {
+      std::free(message);
+      throw;
+    }
+    return message;
+  }
+
+  void destroy_message(void * message) const override
+  {
+    m_root_value_type->fini_message(message);
+    std::free(message);
+  }
+
+  uint64_t layout_hash() const override {return m_layout_hash;}
+
+  size_t flat_size(const void * src) const override
+  {
+    FlatWriter writer{nullptr};
+    flatten_struct(writer, src, m_root_value_type);
+    return 4 + writer.pos();
+  }
+
+  void flatten(void * dst, const void * src) const override
+  {
+    auto header = static_cast<uint8_t *>(dst);
+    header[0] = flat_encoding[0];
+    header[1] = flat_encoding[1];
+    header[2] = static_cast<uint8_t>(m_layout_hash);
+    header[3] = static_cast<uint8_t>(m_layout_hash >> 8);
+    FlatWriter writer{header + 4};
+    flatten_struct(writer, src, m_root_value_type);
+  }
+
+  bool unflatten(void * dst, const void * payload, size_t size) const override
+  {
+    auto header = static_cast<const uint8_t *>(payload);
+    if (!is_flat_payload(payload, size) ||
+      header[2] != static_cast<uint8_t>(m_layout_hash) ||
+      header[3] != static_cast<uint8_t>(m_layout_hash >> 8))
+    {
+      return false;
+    }
+    FlatReader reader{header + 4, size - 4};
+    unflatten_struct(dst, reader, m_root_value_type);
+    return true;
+  }
+
+protected:
+  bool register_type(const AnyValueType * value_type)
+  {
+    auto iter = plain_cache.find(value_type);
+    if (iter != plain_cache.end()) {
+      return iter->second;
+    }
+
+    bool plain;
+    switch (value_type->e_value_type()) {
+      case EValueType::PrimitiveValueType:
+        plain = true;
+        plain_holes.emplace(value_type, std::vector<Hole>{});
+        break;
+      case EValueType::ArrayValueType: {
+          auto array_info = static_cast<const ArrayValueType *>(value_type);
+          auto element_value_type = array_info->element_value_type();
+          plain = register_type(element_value_type);
+          if (plain) {
+            std::vector<Hole> holes;
+            size_t element_size = element_value_type->sizeof_type();
+            for (size_t i = 0; i < array_info->array_size(); i++) {
+              add_holes(holes, i * element_size, plain_holes.at(element_value_type));
+            }
+            plain_holes.emplace(value_type, std::move(holes));
+          }
+          break;
+        }
+      case EValueType::SpanSequenceValueType:
+        register_type(static_cast<const SpanSequenceValueType *>(value_type)->element_value_type());
+        plain = false;
+        break;
+      case EValueType::StructValueType:
+        plain = register_struct(static_cast<const StructValueType *>(value_type));
+        break;
+      case EValueType::U8StringValueType:
+      case EValueType::U16StringValueType:
+      case EValueType::BoolVectorValueType:
+        plain = false;
+        break;
+      default:
+        unreachable();
+    }
+    plain_cache.emplace(value_type, plain);
+    return plain;
+  }
+
+  bool register_struct(const StructValueType * struct_info)
+  {
+    std::vector<CopyStep> steps;
+    bool plain = true;
+    for (size_t i = 0; i < struct_info->n_members(); i++) {
+      auto member = struct_info->get_member(i);
+      if (register_type(member->value_type)) {
+        size_t end = member->member_offset + member->value_type->sizeof_type();
+        if (!steps.empty() && steps.back().value_type == nullptr) {
+          // extend the preceding memcpy, including any padding in between
+          auto & step = steps.back();
+          size_t step_end = step.offset + step.size;
+          if (member->member_offset > step_end) {
+            step.holes.push_back(Hole{step_end - step.offset, member->member_offset - step_end});
+          }
+          step.size = end - step.offset;
+        } else {
+          steps.push_back(
+            CopyStep{member->member_offset, end - member->member_offset, nullptr, {}});
+        }
+        add_holes(
+          steps.back().holes, member->member_offset - steps.back().offset,
+          plain_holes.at(member->value_type));
+      } else {
+        plain = false;
+        steps.push_back(CopyStep{member->member_offset, 0, member->value_type, {}});
+      }
+    }
+    if (plain) {
+      // all of the struct outside the one memcpy is padding
+      std::vector<Hole> holes;
+      size_t begin = steps.empty() ? struct_info->sizeof_struct() : steps.front().offset;
+      size_t end = steps.empty() ? begin : begin + steps.front().size;
+      if (begin > 0) {
+        holes.push_back(Hole{0, begin});
+      }
+      if (!steps.empty()) {
+        add_holes(holes, begin, steps.front().holes);
+      }
+      if (struct_info->sizeof_struct() > end) {
+        holes.push_back(Hole{end, struct_info->sizeof_struct() - end});
+      }
+      plain_holes.emplace(struct_info, std::move(holes));
+    }
+    struct_steps.emplace(struct_info, std::move(steps));
+    return plain;
+  }
+
+  static void add_holes(std::vector<Hole> & holes, size_t offset, const std::vector<Hole> & more)
+  {
+    for (auto & hole : more) {
+      holes.push_back(Hole{offset + hole.offset, hole.size});
+    }
+  }
+
+  static void zero_holes(byte * dst, const std::vector<Hole> & holes)
+  {
+    for (auto & hole : holes) {
+      std::memset(dst + hole.offset, 0, hole.size);
+    }
+  }
+
+  bool is_plain(const AnyValueType * value_type) const
+  {
+    return plain_cache.at(value_type);
+  }
+
+  /// Describes everything about the layout of a type the native flat representation depends on
+  void describe_layout(std::string & out, const AnyValueType * value_type) const
+  {
+    out += std::to_string(static_cast<int>(value_type->e_value_type())) + ":" +
+      std::to_string(value_type->sizeof_type());
+    switch (value_type->e_value_type()) {
+      case EValueType::PrimitiveValueType:
+        out += ":" + std::to_string(
+          static_cast<int>(static_cast<const PrimitiveValueType *>(value_type)->type_kind()));
+        break;
+      case EValueType::ArrayValueType: {
+          auto array_info = static_cast<const ArrayValueType *>(value_type);
+          out += "[" + std::to_string(array_info->array_size());
+          describe_layout(out, array_info->element_value_type());
+          out += "]";
+          break;
+        }
+      case EValueType::SpanSequenceValueType:
+        out += "<";
+        describe_layout(
+          out, static_cast<const SpanSequenceValueType *>(value_type)->element_value_type());
+        out += ">";
+        break;
+      case EValueType::StructValueType: {
+          auto struct_info = static_cast<const StructValueType *>(value_type);
+          out += "{";
+          for (size_t i = 0; i < struct_info->n_members(); i++) {
+            auto member = struct_info->get_member(i);
+            out += std::string(member->name) + "@" + std::to_string(member->member_offset) + "=";
+            describe_layout(out, member->value_type);
+            out += ";";
+          }
+          out += "}";
+          break;
+        }
+      case EValueType::U8StringValueType:
+      case EValueType::U16StringValueType:
+      case EValueType::BoolVectorValueType:
+        break;
+      default:
+        unreachable();
+    }
+  }
+
+  void flatten_struct(
+    FlatWriter & writer, const void * src,
+    const StructValueType * struct_info) const
+  {
+    for (auto & step : struct_steps.at(struct_info)) {
+      const void * member_src = byte_offset(src, step.offset);
+      if (step.value_type == nullptr) {
+        if (byte * dst = writer.put(member_src, step.size)) {
+          zero_holes(dst, step.holes);
+        }
+      } else {
+        flatten_value(writer, member_src, step.value_type);
+      }
+    }
+  }
+
+  void flatten_many(
+    FlatWriter & writer, const void * src, size_t count,
+    const AnyValueType * element_value_type) const
+  {
+    size_t element_size = element_value_type->sizeof_type();
+    if (is_plain(element_value_type)) {
+      byte * dst = writer.put(src, count * element_size);
+      auto & holes = plain_holes.at(element_value_type);
+      if (dst && !holes.empty()) {
+        for (size_t i = 0; i < count; i++) {
+          zero_holes(dst + i * element_size, holes);
+        }
+      }
+      return;
+    }
+    for (size_t i = 0; i < count; i++) {
+      flatten_value(writer, byte_offset(src, i * element_size), element_value_type);
+    }
+  }
+
+  void flatten_value(FlatWriter & writer, const void * src, const AnyValueType * value_type) const
+  {
+    switch (value_type->e_value_type()) {
+      case EValueType::PrimitiveValueType:
+        writer.put(src, value_type->sizeof_type());
+        break;
+      case EValueType::U8StringValueType: {
+          auto str = static_cast<const U8StringValueType *>(value_type)->data(src);
+          writer.put_count(str.size());
+          writer.put(str.data(), str.size_bytes());
+          break;
+        }
+      case EValueType::U16StringValueType: {
+          auto str = static_cast<const U16StringValueType *>(value_type)->data(src);
+          writer.put_count(str.size());
+          writer.put(str.data(), str.size_bytes());
+          break;
+        }
+      case EValueType::StructValueType:
+        flatten_struct(writer, src, static_cast<const StructValueType *>(value_type));
+        break;
+      case EValueType::ArrayValueType: {
+          auto array_info = static_cast<const ArrayValueType *>(value_type);
+          flatten_many(writer, src, array_info->array_size(), array_info->element_value_type());
+          break;
+        }
+      case EValueType::SpanSequenceValueType: {
+          auto sequence_info = static_cast<const SpanSequenceValueType *>(value_type);
+          size_t size = sequence_info->sequence_size(src);
+          writer.put_count(size);
+          if (size > 0) {
+            flatten_many(
+              writer, sequence_info->sequence_contents(src), size,
+              sequence_info->element_value_type());
+          }
+          break;
+        }
+      case EValueType::BoolVectorValueType: {
+          auto vector_info = static_cast<const BoolVectorValueType *>(value_type);
+          writer.put_count(vector_info->size(src));
+          std::vector<uint8_t> values(vector_info->begin(src), vector_info->end(src));
+          writer.put(values.data(), values.size());
+          break;
+        }
+      default:
+        unreachable();
+    }
+  }
+
+  void unflatten_struct(void * dst, FlatReader & reader, const StructValueType * struct_info) const
+  {
+    for (auto & step : struct_steps.at(struct_info)) {
+      void * member_dst = byte_offset(dst, step.offset);
+      if (step.value_type == nullptr) {
+        std::memcpy(member_dst, reader.get(step.size), step.size);
+      } else {
+        unflatten_value(member_dst, reader, step.value_type);
+      }
+    }
+  }
+
+  void unflatten_many(
+    void * dst, FlatReader & reader, size_t count,
+    const AnyValueType * element_value_type) const
+  {
+    size_t element_size = element_value_type->sizeof_type();
+    if (is_plain(element_value_type)) {
+      if (count > 0) {
+        std::memcpy(dst, reader.get(count * element_size), count * element_size);
+      }
+      return;
+    }
+    for (size_t i = 0; i < count; i++) {
+      unflatten_value(byte_offset(dst, i * element_size), reader, element_value_type);
+    }
+  }
+
+  void unflatten_value(void * dst, FlatReader & reader, const AnyValueType * value_type) const
+  {
+    switch (value_type->e_value_type()) {
+      case EValueType::PrimitiveValueType:
+        std::memcpy(dst, reader.get(value_type->sizeof_type()), value_type->sizeof_type());
+        break;
+      case EValueType::U8StringValueType: {
+          using char_type = U8StringValueType::char_traits::char_type;
+          size_t size = reader.get_count(sizeof(char_type));
+          auto chars = static_cast<const char_type *>(reader.get(size * sizeof(char_type)));
+          static_cast<const U8StringValueType *>(value_type)->assign(dst, chars, size);
+          break;
+        }
+      case EValueType::U16StringValueType: {
+          using char_type = U16StringValueType::char_traits::char_type;
+          size_t size = reader.get_count(sizeof(char_type));
+          auto chars = static_cast<const char_type *>(reader.get(size * sizeof(char_type)));
+          static_cast<const U16StringValueType *>(value_type)->assign(dst, chars, size);
+          break;
+        }
+      case EValueType::StructValueType:
+        unflatten_struct(dst, reader, static_cast<const StructValueType *>(value_type));
+        break;
+      case EValueType::ArrayValueType: {
+          auto array_info = static_cast<const ArrayValueType *>(value_type);
+          unflatten_many(dst, reader, array_info->array_size(), array_info->element_value_type());
+          break;
+        }
+      case EValueType::SpanSequenceValueType: {
+          auto sequence_info = static_cast<const SpanSequenceValueType *>(value_type);
+          auto element_value_type = sequence_info->element_value_type();
+          // every element of a non-plain type takes at least the 8 bytes of a count
+          size_t size = reader.get_count(
+            is_plain(element_value_type) ? element_value_type->sizeof_type() : 8);
+          sequence_info->resize(dst, size);
+          if (size > 0) {
+            unflatten_many(
+              sequence_info->mutable_sequence_contents(dst), reader, size, element_value_type);
+          }
+          break;
+        }
+      case EValueType::BoolVectorValueType: {
+          size_t size = reader.get_count(1);
+          auto values = static_cast<const uint8_t *>(reader.get(size));
+          static_cast<const BoolVectorValueType *>(value_type)->assign(dst, values, size);
+          break;
+        }
+      default:
+        unreachable();
+    }
+  }
+
+  void copy_struct(void * dst, const void * src, const StructValueType * struct_info) const
+  {
+    for (auto & step : struct_steps.at(struct_info)) {
+      void * member_dst = byte_offset(dst, step.offset);
+      const void * member_src = byte_offset(src, step.offset);
+      if (step.value_type == nullptr) {
+        std::memcpy(member_dst, member_src, step.size);
+      } else {
+        copy_value(member_dst, member_src, step.value_type);
+      }
+    }
+  }
+
+  void copy_many(
+    void * dst, const void * src, size_t count,
+    const AnyValueType * element_value_type) const
+  {
+    if (count == 0) {
+      return;
+    }
+    size_t element_size = element_value_type->sizeof_type();
+    if (is_plain(element_value_type)) {
+      std::memcpy(dst, src, count * element_size);
+      return;
+    }
+    for (size_t i = 0; i < count; i++) {
+      copy_value(
+        byte_offset(dst, i * element_size), byte_offset(src, i * element_size),
+        element_value_type);
+    }
+  }
+
+  void copy_value(void * dst, const void * src, const AnyValueType * value_type) const
+  {
+    switch (value_type->e_value_type()) {
+      case EValueType::PrimitiveValueType:
+        std::memcpy(dst, src, value_type->sizeof_type());
+        break;
+      case EValueType::U8StringValueType:
+        static_cast<const U8StringValueType *>(value_type)->assign(dst, src);
+        break;
+      case EValueType::U16StringValueType:
+        static_cast<const U16StringValueType *>(value_type)->assign(dst, src);
+        break;
+      case EValueType::StructValueType:
+        copy_struct(dst, src, static_cast<const StructValueType *>(value_type));
+        break;
+      case EValueType::ArrayValueType: {
+          auto array_info = static_cast<const ArrayValueType *>(value_type);
+          copy_many(dst, src, array_info->array_size(), array_info->element_value_type());
+          break;
+        }
+      case EValueType::SpanSequenceValueType: {
+          auto sequence_info = static_cast<const SpanSequenceValueType *>(value_type);
+          size_t size = sequence_info->sequence_size(src);
+          sequence_info->resize(dst, size);
+          if (size > 0) {
+            copy_many(
+              sequence_info->mutable_sequence_contents(dst),
+              sequence_info->sequence_contents(src), size,
+              sequence_info->element_value_type());
+          }
+          break;
+        }
+      case EValueType::BoolVectorValueType:
+        static_cast<const BoolVectorValueType *>(value_type)->assign(dst, src);
+        break;
+      default:
+        unreachable();
+    }
+  }
+};
+
+std::unique_ptr<BaseDeepCopier> make_deep_copier(const StructValueType * value_type)
+{
+  return std::make_unique<DeepCopier>(value_type);
+}
+
+MessagePool::~MessagePool()
+{
+  for (auto message : m_free) {
+    m_copier->destroy_message(message);
+  }
+  if (m_default != nullptr) {
+    m_copier->destroy_message(m_default);
+  }
+}
+
+void * MessagePool::get()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_free.empty()) {
+      void * message = m_free.back();
+      m_free.pop_back();
+      return message;
+    }
+  }
+  return m_copier->make_message();
+}
+
+void * MessagePool::get_default()
+{
+  void * message = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_free.empty()) {
+      if (m_default == nullptr) {
+        m_default = m_copier->make_message();
+      }
+      message = m_free.back();
+      m_free.pop_back();
+    }
+  }
+  if (message == nullptr) {
+    return m_copier->make_message();
+  }
+  // m_default never changes once created, so it can be copied without holding the lock
+  try {
+    m_copier->copy(message, m_default);
+  } catch (...) {
+    put(message);
+    throw;
+  }
+  return message;
+}
+
+void MessagePool::put(void * message)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_free.size() < m_max_cached) {
+      m_free.push_back(message);
+      return;
+    }
+  }
+  m_copier->destroy_message(message);
+}
+}  // namespace rmw_cyclonedds_cpp
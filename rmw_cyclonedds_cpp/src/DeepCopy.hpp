@@ -0,0 +1,95 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DEEPCOPY_HPP_
+#define DEEPCOPY_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "TypeSupport2.hpp"
+
+namespace rmw_cyclonedds_cpp
+{
+
+/// Copies messages directly from one in-memory representation to another, for delivering
+/// samples within a process without a round trip through CDR.
+class BaseDeepCopier
+{
+public:
+  /// Copy the message src to dst.  dst must be an initialized message of the same type; its
+  /// strings and sequences are assigned, so their storage is reused where possible.
+  virtual void copy(void * dst, const void * src) const = 0;
+  /// Allocate and initialize a message
+  virtual void * make_message() const = 0;
+  /// Finalize and free a message returned by make_message
+  virtual void destroy_message(void * message) const = 0;
+
+  /// Hash of the in-memory layout of the type, equal only if messages can be exchanged in the
+  /// native flat representation
+  virtual uint64_t layout_hash() const = 0;
+  /// Size of the native flat representation of src, including the encapsulation header
+  virtual size_t flat_size(const void * src) const = 0;
+  /// Write the native flat representation of src to dst, which must have room for
+  /// flat_size(src) bytes
+  virtual void flatten(void * dst, const void * src) const = 0;
+  /// Copy a native flat representation into the initialized message dst.  Returns false if it
+  /// was produced for a different layout, throws if it is malformed.
+  virtual bool unflatten(void * dst, const void * payload, size_t size) const = 0;
+  virtual ~BaseDeepCopier() = default;
+};
+
+/// Whether a payload is in the native flat representation rather than in CDR.
+///
+/// The native flat representation is an exchange format for peers with identical layouts of a
+/// type (same type support, compiler and architecture): after an encapsulation header
+/// identifying it and carrying the low 16 bits of the layout hash, it has the runs of plain
+/// members of a struct as they are in memory, each followed by the length and contents of the
+/// string or sequence following it.  Everything is 8-byte aligned, so for a plain type it is
+/// the message itself.
+bool is_flat_payload(const void * payload, size_t size);
+
+std::unique_ptr<BaseDeepCopier> make_deep_copier(const StructValueType * value_type);
+
+/// Recycles messages, keeping them initialized so that their strings and sequences retain their
+/// storage from one use to the next
+class MessagePool
+{
+  const BaseDeepCopier * m_copier;
+  const size_t m_max_cached;
+  std::mutex m_lock;
+  std::vector<void *> m_free;
+  /// A message in its default state, created on first use by get_default
+  void * m_default {nullptr};
+
+public:
+  MessagePool(const BaseDeepCopier * copier, size_t max_cached)
+  : m_copier{copier}, m_max_cached{max_cached}
+  {
+  }
+  MessagePool(const MessagePool &) = delete;
+  MessagePool & operator=(const MessagePool &) = delete;
+  ~MessagePool();
+
+  /// An initialized message, with whatever contents it had when it was returned to the pool
+  void * get();
+  /// An initialized message in its default state; its strings and sequences still retain their
+  /// storage
+  void * get_default();
+  void put(void * message);
+};
+}  // namespace rmw_cyclonedds_cpp
+
+#endif  // DEEPCOPY_HPP_
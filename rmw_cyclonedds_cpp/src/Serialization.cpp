@@ -20,6 +20,7 @@
 
 #include "Serialization.hpp"
 
+#include <algorithm>
 #include <array>
 #include <limits>
 #include <memory>
@@ -117,6 +118,83 @@ struct DataCursor : public CDRCursor
   void rebase(ptrdiff_t relative_origin) final {origin = byte_offset(origin, relative_origin);}
 };
 
+struct SegmentCursor : public CDRCursor
+{
+  CDRSegmentList & out;
+  const size_t min_ref_size;
+  size_t position;
+  ptrdiff_t origin;
+
+  SegmentCursor(CDRSegmentList & out, size_t min_ref_size)
+  : out(out), min_ref_size(min_ref_size), position(0), origin(0) {}
+
+  size_t offset() const final
+  {
+    return static_cast<size_t>(static_cast<ptrdiff_t>(position) - origin);
+  }
+  void advance(size_t n_bytes) final {put_inline(nullptr, n_bytes);}
+  void put_bytes(const void * bytes, size_t n_bytes) final
+  {
+    if (n_bytes == 0) {
+      return;
+    }
+    if (n_bytes < min_ref_size) {
+      put_inline(bytes, n_bytes);
+    } else {
+      out.segments.push_back(CDRSegment{position, n_bytes, bytes, 0});
+      position += n_bytes;
+    }
+  }
+  bool ignores_data() const final {return false;}
+  void rebase(ptrdiff_t relative_origin) final {origin += relative_origin;}
+
+protected:
+  // Copy bytes (or zeros if bytes is null) to the side buffer, extending the last segment if
+  // that one is also in the side buffer
+  void put_inline(const void * bytes, size_t n_bytes)
+  {
+    if (n_bytes == 0) {
+      return;
+    }
+    size_t inline_offset = out.inline_data.size();
+    if (bytes == nullptr) {
+      out.inline_data.resize(inline_offset + n_bytes, byte());
+    } else {
+      auto src = static_cast<const byte *>(bytes);
+      out.inline_data.insert(out.inline_data.end(), src, src + n_bytes);
+    }
+    if (!out.segments.empty() && out.segments.back().ref == nullptr) {
+      out.segments.back().size += n_bytes;
+    } else {
+      out.segments.push_back(CDRSegment{position, n_bytes, nullptr, inline_offset});
+    }
+    position += n_bytes;
+  }
+};
+
+void CDRSegmentList::copy_out(size_t offset, size_t size, void * dest) const
+{
+  assert(offset + size <= serialized_size());
+  auto it = std::upper_bound(
+    segments.begin(), segments.end(), offset,
+    [](size_t off, const CDRSegment & s) {return off < s.offset;});
+  assert(it != segments.begin());
+  --it;
+  while (size > 0) {
+    assert(it != segments.end());
+    size_t skip = offset - it->offset;
+    size_t n_bytes = std::min(size, it->size - skip);
+    const void * src = it->ref ?
+      byte_offset(it->ref, skip) :
+      byte_offset(inline_data.data(), it->inline_offset + skip);
+    std::memcpy(dest, src, n_bytes);
+    dest = byte_offset(dest, n_bytes);
+    offset += n_bytes;
+    size -= n_bytes;
+    ++it;
+  }
+}
+
 enum class EncodingVersion
 {
   CDR_Legacy,
@@ -160,6 +238,20 @@ public:
     register_serializable_type(m_root_value_type.get());
   }
 
+  const StructValueType * value_type() const override {return m_root_value_type.get();}
+
+  bool is_plain() const override
+  {
+    return eversion == EncodingVersion::CDR_Legacy && m_root_value_type->n_members() > 0 &&
+           lookup_trivially_serialized(0, m_root_value_type.get());
+  }
+
+  void serialize_header(void * dest) const override
+  {
+    DataCursor cursor(dest);
+    put_rtps_header(&cursor);
+  }
+
   void register_serializable_type(const AnyValueType * t)
   {
     for (size_t align = 0; align < max_align; align++) {
@@ -235,6 +327,14 @@ public:
     serialize_top_level(&cursor, request);
   }
 
+  void serialize_segments(
+    CDRSegmentList & out, const void * data,
+    size_t min_ref_size) const override
+  {
+    SegmentCursor cursor(out, min_ref_size);
+    serialize_top_level(&cursor, data);
+  }
+
   void serialize_top_level(
     CDRCursor * cursor, const void * data) const
   {
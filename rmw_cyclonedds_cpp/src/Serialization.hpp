@@ -15,14 +15,43 @@
 #define SERIALIZATION_HPP_
 
 #include <memory>
+#include <vector>
 
 #include "TypeSupport2.hpp"
+#include "bytewise.hpp"
 #include "rosidl_runtime_c/service_type_support_struct.h"
 #include "serdata.hpp"
 
 namespace rmw_cyclonedds_cpp
 {
 
+/// A piece of the serialized representation of a sample.  Large runs of trivially serialized
+/// data are referenced in the sample itself, everything else is copied into a side buffer.
+struct CDRSegment
+{
+  /// offset of this segment in the serialized representation
+  size_t offset;
+  size_t size;
+  /// if non-null, the bytes live in the sample; else they are in CDRSegmentList::inline_data
+  const void * ref;
+  size_t inline_offset;
+};
+
+/// The serialized representation of a sample as a list of segments in order of increasing
+/// offset, which allows producing any range of it without serializing the whole sample.
+struct CDRSegmentList
+{
+  std::vector<CDRSegment> segments;
+  std::vector<byte> inline_data;
+
+  size_t serialized_size() const
+  {
+    return segments.empty() ? 0 : segments.back().offset + segments.back().size;
+  }
+  /// copy the bytes [offset, offset + size) of the serialized representation to dest
+  void copy_out(size_t offset, size_t size, void * dest) const;
+};
+
 class BaseCDRWriter
 {
 public:
@@ -30,6 +59,18 @@ public:
   virtual void serialize(void * dest, const void * data) const = 0;
   virtual size_t get_serialized_size(const cdds_request_wrapper_t & request) const = 0;
   virtual void serialize(void * dest, const cdds_request_wrapper_t & request) const = 0;
+  /// Record the serialized representation as segments, referencing runs of at least
+  /// min_ref_size bytes in data.  The result is only valid as long as data is.
+  virtual void serialize_segments(
+    CDRSegmentList & out, const void * data,
+    size_t min_ref_size) const = 0;
+  /// The type of the messages this writer serializes
+  virtual const StructValueType * value_type() const = 0;
+  /// True if a message serializes as the encapsulation header followed by a verbatim copy of
+  /// the message, so that messages can be constructed in place in a serialized buffer
+  virtual bool is_plain() const = 0;
+  /// Write the 4-byte encapsulation header that precedes every serialized message
+  virtual void serialize_header(void * dest) const = 0;
   virtual ~BaseCDRWriter() = default;
 };
 
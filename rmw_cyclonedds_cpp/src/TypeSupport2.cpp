@@ -20,6 +20,8 @@
 
 namespace rmw_cyclonedds_cpp
 {
+std::unique_ptr<PrimitiveValueType> BoolVectorValueType::s_element_value_type;
+
 class ROSIDLC_StructValueType : public StructValueType
 {
   const rosidl_typesupport_introspection_c__MessageMembers * impl;
@@ -41,6 +43,11 @@ public:
   size_t sizeof_struct() const override {return impl->size_of_;}
   size_t n_members() const override {return impl->member_count_;}
   const Member * get_member(size_t index) const override {return &m_members.at(index);}
+  void init_message(void * ptr_to_struct) const override
+  {
+    impl->init_function(ptr_to_struct, ROSIDL_RUNTIME_C_MSG_INIT_ALL);
+  }
+  void fini_message(void * ptr_to_struct) const override {impl->fini_function(ptr_to_struct);}
 };
 
 class ROSIDLCPP_StructValueType : public StructValueType
@@ -64,6 +71,11 @@ public:
   size_t sizeof_struct() const override {return impl->size_of_;}
   size_t n_members() const override {return impl->member_count_;}
   const Member * get_member(size_t index) const final {return &m_members.at(index);}
+  void init_message(void * ptr_to_struct) const override
+  {
+    impl->init_function(ptr_to_struct, rosidl_runtime_cpp::MessageInitialization::ALL);
+  }
+  void fini_message(void * ptr_to_struct) const override {impl->fini_function(ptr_to_struct);}
 };
 
 std::unique_ptr<StructValueType> make_message_value_type(const rosidl_message_type_support_t * mts)
@@ -111,6 +123,34 @@ make_request_response_value_types(const rosidl_service_type_support_t * svc_ts)
           "Unidentified service type support: " + std::string(svc_ts->typesupport_identifier));
 }
 
+void ROSIDLC_SpanSequenceValueType::init_elements(void * elements, size_t count) const
+{
+  size_t element_size = m_element_value_type->sizeof_type();
+  for (size_t i = 0; i < count; i++) {
+    void * element = byte_offset(elements, i * element_size);
+    switch (m_element_value_type->e_value_type()) {
+      case EValueType::U8StringValueType:
+        if (!rosidl_runtime_c__String__init(static_cast<rosidl_runtime_c__String *>(element))) {
+          throw std::bad_alloc();
+        }
+        break;
+      case EValueType::U16StringValueType:
+        if (!rosidl_runtime_c__U16String__init(
+            static_cast<rosidl_runtime_c__U16String *>(element)))
+        {
+          throw std::bad_alloc();
+        }
+        break;
+      case EValueType::StructValueType:
+        static_cast<const StructValueType *>(m_element_value_type)->init_message(element);
+        break;
+      default:
+        std::memset(element, 0, element_size);
+        break;
+    }
+  }
+}
+
 ROSIDLC_StructValueType::ROSIDLC_StructValueType(
   const rosidl_typesupport_introspection_c__MessageMembers * impl)
 : impl{impl}, m_members{}, m_inner_value_types{}
@@ -144,7 +184,8 @@ ROSIDLC_StructValueType::ROSIDLC_StructValueType(
         element_value_type, member_impl.array_size_);
     } else if (member_impl.size_function) {
       member_value_type = make_value_type<CallbackSpanSequenceValueType>(
-        element_value_type, member_impl.size_function, member_impl.get_const_function);
+        element_value_type, member_impl.size_function, member_impl.get_const_function,
+        member_impl.get_function, member_impl.resize_function);
     } else {
       member_value_type = make_value_type<ROSIDLC_SpanSequenceValueType>(element_value_type);
     }
@@ -192,7 +233,8 @@ ROSIDLCPP_StructValueType::ROSIDLCPP_StructValueType(
       member_value_type = make_value_type<BoolVectorValueType>();
     } else {
       member_value_type = make_value_type<CallbackSpanSequenceValueType>(
-        element_value_type, member_impl.size_function, member_impl.get_const_function);
+        element_value_type, member_impl.size_function, member_impl.get_const_function,
+        member_impl.get_function, member_impl.resize_function);
     }
     m_members.push_back(
       Member {
@@ -15,9 +15,13 @@
 #define TYPESUPPORT2_HPP_
 
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <new>
 #include <regex>
+#include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
@@ -186,6 +190,10 @@ public:
   virtual size_t sizeof_struct() const = 0;
   virtual size_t n_members() const = 0;
   virtual const Member * get_member(size_t) const = 0;
+  // construct a message of this type in sizeof_struct() bytes of uninitialized memory
+  virtual void init_message(void * ptr_to_struct) const = 0;
+  // destruct a message constructed with init_message, leaving the memory uninitialized
+  virtual void fini_message(void * ptr_to_struct) const = 0;
   EValueType e_value_type() const final {return EValueType::StructValueType;}
 };
 
@@ -214,6 +222,9 @@ public:
   virtual const AnyValueType * element_value_type() const = 0;
   virtual size_t sequence_size(const void * ptr_to_sequence) const = 0;
   virtual const void * sequence_contents(const void * ptr_to_sequence) const = 0;
+  virtual void * mutable_sequence_contents(void * ptr_to_sequence) const = 0;
+  // change the number of elements, new elements are initialized
+  virtual void resize(void * ptr_to_sequence, size_t size) const = 0;
   EValueType e_value_type() const final {return EValueType::SpanSequenceValueType;}
 };
 
@@ -223,18 +234,26 @@ protected:
   const AnyValueType * m_element_value_type;
   std::function<size_t(const void *)> m_size_function;
   std::function<const void * (const void *, size_t index)> m_get_const_function;
+  std::function<void * (void *, size_t index)> m_get_function;
+  std::function<void(void *, size_t size)> m_resize_function;
 
 public:
   CallbackSpanSequenceValueType(
     const AnyValueType * element_value_type, decltype(m_size_function) size_function,
-    decltype(m_get_const_function) get_const_function)
+    decltype(m_get_const_function) get_const_function,
+    decltype(m_get_function) get_function,
+    decltype(m_resize_function) resize_function)
   : m_element_value_type(element_value_type),
     m_size_function(size_function),
-    m_get_const_function(get_const_function)
+    m_get_const_function(get_const_function),
+    m_get_function(get_function),
+    m_resize_function(resize_function)
   {
     assert(m_element_value_type);
     assert(size_function);
     assert(get_const_function);
+    assert(get_function);
+    assert(resize_function);
   }
 
   size_t sizeof_type() const override {throw std::logic_error("not implemented");}
@@ -250,6 +269,17 @@ public:
     }
     return m_get_const_function(ptr_to_sequence, 0);
   }
+  void * mutable_sequence_contents(void * ptr_to_sequence) const override
+  {
+    if (sequence_size(ptr_to_sequence) == 0) {
+      return nullptr;
+    }
+    return m_get_function(ptr_to_sequence, 0);
+  }
+  void resize(void * ptr_to_sequence, size_t size) const override
+  {
+    m_resize_function(ptr_to_sequence, size);
+  }
 };
 
 class ROSIDLC_SpanSequenceValueType : public SpanSequenceValueType
@@ -267,6 +297,13 @@ protected:
   {
     return static_cast<const ROSIDLC_SequenceObject *>(ptr_to_sequence);
   }
+  ROSIDLC_SequenceObject * get_value(void * ptr_to_sequence) const
+  {
+    return static_cast<ROSIDLC_SequenceObject *>(ptr_to_sequence);
+  }
+
+  // initialize elements in freshly allocated storage
+  void init_elements(void * elements, size_t count) const;
 
 public:
   explicit ROSIDLC_SpanSequenceValueType(const AnyValueType * element_value_type)
@@ -284,6 +321,28 @@ public:
   {
     return get_value(ptr_to_sequence)->data;
   }
+  void * mutable_sequence_contents(void * ptr_to_sequence) const final
+  {
+    return get_value(ptr_to_sequence)->data;
+  }
+  void resize(void * ptr_to_sequence, size_t size) const final
+  {
+    auto seq = get_value(ptr_to_sequence);
+    if (size <= seq->capacity) {
+      // elements beyond size remain initialized, the sequence's fini function takes care of them
+      seq->size = size;
+      return;
+    }
+    size_t element_size = m_element_value_type->sizeof_type();
+    void * data = std::realloc(seq->data, size * element_size);
+    if (data == nullptr) {
+      throw std::bad_alloc();
+    }
+    init_elements(byte_offset(data, seq->capacity * element_size), size - seq->capacity);
+    seq->data = data;
+    seq->size = size;
+    seq->capacity = size;
+  }
 };
 
 struct PrimitiveValueType : public AnyValueType
@@ -371,6 +430,15 @@ public:
     return get_value(ptr_to_sequence)->end();
   }
   size_t size(const void * ptr_to_sequence) const {return get_value(ptr_to_sequence)->size();}
+  void assign(void * dst, const void * src) const
+  {
+    *static_cast<std::vector<bool> *>(dst) = *get_value(src);
+  }
+  // set the (initialized) vector dst to the size values, each nonzero byte being true
+  void assign(void * dst, const uint8_t * values, size_t size) const
+  {
+    static_cast<std::vector<bool> *>(dst)->assign(values, values + size);
+  }
   EValueType e_value_type() const final {return EValueType::BoolVectorValueType;}
 };
 
@@ -382,6 +450,12 @@ public:
   using char_traits = std::char_traits<char>;
   virtual TypedSpan<char_traits::char_type> data(void *) const = 0;
   virtual TypedSpan<const char_traits::char_type> data(const void *) const = 0;
+  // copy the string src to the (initialized) string dst
+  virtual void assign(void * dst, const void * src) const = 0;
+  // set the (initialized) string dst to the size characters at chars
+  virtual void assign(
+    void * dst, const char_traits::char_type * chars,
+    size_t size) const = 0;
   EValueType e_value_type() const final {return EValueType::U8StringValueType;}
 };
 
@@ -391,6 +465,12 @@ public:
   using char_traits = std::char_traits<char16_t>;
   virtual TypedSpan<char_traits::char_type> data(void *) const = 0;
   virtual TypedSpan<const char_traits::char_type> data(const void *) const = 0;
+  // copy the string src to the (initialized) string dst
+  virtual void assign(void * dst, const void * src) const = 0;
+  // set the (initialized) string dst to the size characters at chars
+  virtual void assign(
+    void * dst, const char_traits::char_type * chars,
+    size_t size) const = 0;
   EValueType e_value_type() const final {return EValueType::U16StringValueType;}
 };
 
@@ -413,6 +493,17 @@ public:
     assert(str->data[str->size + 1] == 0);
     return {str->data, str->size};
   }
+  void assign(void * dst, const void * src) const override
+  {
+    auto str = static_cast<const type *>(src);
+    assign(dst, str->data, str->size);
+  }
+  void assign(void * dst, const char_traits::char_type * chars, size_t size) const override
+  {
+    if (!rosidl_runtime_c__String__assignn(static_cast<type *>(dst), chars, size)) {
+      throw std::runtime_error("unable to assign rosidl_runtime_c__String");
+    }
+  }
   size_t sizeof_type() const override {return sizeof(type);}
 };
 
@@ -431,6 +522,21 @@ public:
     auto str = static_cast<type *>(ptr);
     return {reinterpret_cast<char_traits::char_type *>(str->data), str->size};
   }
+  void assign(void * dst, const void * src) const override
+  {
+    auto str = static_cast<const type *>(src);
+    if (!rosidl_runtime_c__U16String__assignn(static_cast<type *>(dst), str->data, str->size)) {
+      throw std::runtime_error("unable to assign rosidl_runtime_c__U16String");
+    }
+  }
+  void assign(void * dst, const char_traits::char_type * chars, size_t size) const override
+  {
+    if (!rosidl_runtime_c__U16String__assignn(
+        static_cast<type *>(dst), reinterpret_cast<const uint16_t *>(chars), size))
+    {
+      throw std::runtime_error("unable to assign rosidl_runtime_c__U16String");
+    }
+  }
   size_t sizeof_type() const override {return sizeof(type);}
 };
 
@@ -449,6 +555,14 @@ public:
     auto str = static_cast<type *>(ptr);
     return {str->data(), str->size()};
   }
+  void assign(void * dst, const void * src) const override
+  {
+    *static_cast<type *>(dst) = *static_cast<const type *>(src);
+  }
+  void assign(void * dst, const char_traits::char_type * chars, size_t size) const override
+  {
+    static_cast<type *>(dst)->assign(chars, size);
+  }
   size_t sizeof_type() const override {return sizeof(type);}
 };
 
@@ -467,6 +581,14 @@ public:
     auto str = static_cast<type *>(ptr);
     return {str->data(), str->size()};
   }
+  void assign(void * dst, const void * src) const override
+  {
+    *static_cast<type *>(dst) = *static_cast<const type *>(src);
+  }
+  void assign(void * dst, const char_traits::char_type * chars, size_t size) const override
+  {
+    static_cast<type *>(dst)->assign(chars, size);
+  }
   size_t sizeof_type() const override {return sizeof(type);}
 };
 
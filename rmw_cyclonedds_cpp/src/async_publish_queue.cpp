@@ -0,0 +1,236 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "async_publish_queue.hpp"
+
+#include <exception>
+#include <system_error>
+#include <utility>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "rmw/error_handling.h"
+
+std::unique_ptr<AsyncPublishQueue> AsyncPublishQueue::create(
+  const rmw_cyclonedds_cpp::BaseDeepCopier * copier, size_t depth, bool block_when_full,
+  int worker_cpu, PublishFn publish)
+{
+  std::unique_ptr<AsyncPublishQueue> q;
+  try {
+    q.reset(new AsyncPublishQueue(copier, depth, block_when_full, std::move(publish)));
+    q->m_worker = std::thread(&AsyncPublishQueue::worker, q.get());
+  } catch (std::exception & e) {
+    RMW_SET_ERROR_MSG(e.what());
+    return nullptr;
+  }
+#if defined(__linux__)
+  if (worker_cpu >= 0 && worker_cpu < CPU_SETSIZE) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(worker_cpu, &cpus);
+    /* failure to bind the worker is no reason not to publish */
+    static_cast<void>(pthread_setaffinity_np(q->m_worker.native_handle(), sizeof(cpus), &cpus));
+  }
+#else
+  static_cast<void>(worker_cpu);
+#endif
+  return q;
+}
+
+static size_t round_up_to_power_of_2(size_t n)
+{
+  size_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+AsyncPublishQueue::AsyncPublishQueue(
+  const rmw_cyclonedds_cpp::BaseDeepCopier * copier, size_t depth, bool block_when_full,
+  PublishFn publish)
+: m_copier{copier}, m_block_when_full{block_when_full}, m_publish{std::move(publish)},
+  m_mask{round_up_to_power_of_2(depth < 1 ? 1 : depth) - 1},
+  m_slots{new Slot[m_mask + 1]}, m_enqueue_pos{0}, m_dequeue_pos{0}, m_dequeued{0},
+  m_published{0}, m_dropped{0}, m_failed{0}, m_high_water_mark{0},
+  m_sleeping{false}, m_waiting_producers{0}, m_stop{false}
+{
+  for (size_t i = 0; i <= m_mask; i++) {
+    m_slots[i].seq.store(i, std::memory_order_relaxed);
+    m_slots[i].message = nullptr;
+    m_slots[i].valid = false;
+  }
+  try {
+    for (size_t i = 0; i <= m_mask; i++) {
+      m_slots[i].message = m_copier->make_message();
+    }
+  } catch (...) {
+    for (size_t i = 0; i <= m_mask && m_slots[i].message; i++) {
+      m_copier->destroy_message(m_slots[i].message);
+    }
+    throw;
+  }
+}
+
+AsyncPublishQueue::~AsyncPublishQueue()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stop = true;
+  }
+  m_cond.notify_all();
+  m_worker.join();
+  for (size_t i = 0; i <= m_mask; i++) {
+    m_copier->destroy_message(m_slots[i].message);
+  }
+}
+
+void AsyncPublishQueue::wait_for_slot(const Slot * slot, size_t pos)
+{
+  std::unique_lock<std::mutex> lock(m_lock);
+  m_waiting_producers.fetch_add(1, std::memory_order_relaxed);
+  /* pairs with the fence in publish_one: either we see the slot freed or it sees us waiting */
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  m_space_cond.wait(
+    lock, [slot, pos]() {
+      const size_t seq = slot->seq.load(std::memory_order_acquire);
+      return static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos) >= 0;
+    });
+  m_waiting_producers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool AsyncPublishQueue::push(const void * message)
+{
+  Slot * slot;
+  size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+  for (;;) {
+    slot = &m_slots[pos & m_mask];
+    const size_t seq = slot->seq.load(std::memory_order_acquire);
+    const intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+    if (dif == 0) {
+      if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (dif < 0) {
+      /* the slot still holds the message queued one lap ago */
+      if (!m_block_when_full) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      wait_for_slot(slot, pos);
+      pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    } else {
+      pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  /* the position has been claimed, so the slot must be handed to the worker even if copying
+     fails */
+  try {
+    m_copier->copy(slot->message, message);
+    slot->valid = true;
+  } catch (...) {
+    slot->valid = false;
+    slot->seq.store(pos + 1, std::memory_order_release);
+    throw;
+  }
+  slot->seq.store(pos + 1, std::memory_order_release);
+
+  /* the worker's progress is read after the fact, so messages queued after this one may have
+     been dequeued already, or the queue may seem to hold more than fits in it */
+  const size_t dequeued = m_dequeued.load(std::memory_order_relaxed);
+  size_t used = (dequeued < pos + 1) ? pos + 1 - dequeued : 0;
+  if (used > m_mask + 1) {
+    used = m_mask + 1;
+  }
+  size_t hwm = m_high_water_mark.load(std::memory_order_relaxed);
+  while (used > hwm &&
+    !m_high_water_mark.compare_exchange_weak(hwm, used, std::memory_order_relaxed))
+  {
+  }
+
+  /* pairs with the fence in worker: either the worker sees the message or we see it sleeping */
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_sleeping.load(std::memory_order_relaxed)) {
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+    }
+    m_cond.notify_one();
+  }
+  return true;
+}
+
+bool AsyncPublishQueue::publish_one()
+{
+  Slot * slot = &m_slots[m_dequeue_pos & m_mask];
+  if (slot->seq.load(std::memory_order_acquire) != m_dequeue_pos + 1) {
+    return false;
+  }
+  if (!slot->valid) {
+    m_failed.fetch_add(1, std::memory_order_relaxed);
+  } else if (m_publish(slot->message)) {
+    m_published.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    m_failed.fetch_add(1, std::memory_order_relaxed);
+  }
+  slot->seq.store(m_dequeue_pos + m_mask + 1, std::memory_order_release);
+  m_dequeue_pos++;
+  m_dequeued.store(m_dequeue_pos, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_waiting_producers.load(std::memory_order_relaxed) > 0) {
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+    }
+    m_space_cond.notify_all();
+  }
+  return true;
+}
+
+void AsyncPublishQueue::worker()
+{
+  for (;;) {
+    while (publish_one()) {
+    }
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const Slot * slot = &m_slots[m_dequeue_pos & m_mask];
+    const size_t want = m_dequeue_pos + 1;
+    m_cond.wait(
+      lock, [this, slot, want]() {
+        return m_stop || slot->seq.load(std::memory_order_acquire) == want;
+      });
+    m_sleeping.store(false, std::memory_order_relaxed);
+    if (m_stop) {
+      lock.unlock();
+      /* whatever got queued before the queue is deleted still gets published */
+      while (publish_one()) {
+      }
+      return;
+    }
+  }
+}
+
+AsyncPublishQueue::Stats AsyncPublishQueue::stats() const
+{
+  Stats s;
+  s.published = m_published.load(std::memory_order_relaxed);
+  s.dropped = m_dropped.load(std::memory_order_relaxed);
+  s.failed = m_failed.load(std::memory_order_relaxed);
+  s.high_water_mark = m_high_water_mark.load(std::memory_order_relaxed);
+  s.depth = m_mask + 1;
+  return s;
+}
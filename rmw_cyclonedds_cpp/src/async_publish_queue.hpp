@@ -0,0 +1,116 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ASYNC_PUBLISH_QUEUE_HPP_
+#define ASYNC_PUBLISH_QUEUE_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "DeepCopy.hpp"
+
+/* Moves the cost of publishing off the publishing thread: push copies the message into a
+   preallocated slot of a bounded lock-free queue and returns, a worker thread of the queue's own
+   serializes and writes it.  The messages in the slots are initialized once and reused, so that
+   once their strings and sequences have grown to the sizes needed, pushing doesn't allocate.
+
+   Any number of threads may push concurrently, there is a single consumer, the worker. */
+class AsyncPublishQueue
+{
+public:
+  /* publishes a message, returns false if that failed */
+  using PublishFn = std::function<bool (const void * message)>;
+
+  struct Stats
+  {
+    uint64_t published;
+    uint64_t dropped;
+    uint64_t failed;
+    size_t high_water_mark;
+    size_t depth;
+  };
+
+  /* A queue of at least depth slots (rounded up to a power of 2); when it is full, push either
+     drops the message or waits for a slot to become available.  The worker is bound to CPU
+     worker_cpu if it is non-negative and the platform supports it.  Returns null (and sets the
+     error message) if the worker can't be started. */
+  static std::unique_ptr<AsyncPublishQueue> create(
+    const rmw_cyclonedds_cpp::BaseDeepCopier * copier, size_t depth, bool block_when_full,
+    int worker_cpu, PublishFn publish);
+
+  /* Publishes whatever is still queued before stopping the worker */
+  ~AsyncPublishQueue();
+  AsyncPublishQueue(const AsyncPublishQueue &) = delete;
+  AsyncPublishQueue & operator=(const AsyncPublishQueue &) = delete;
+
+  /* Queues a copy of message, returns false if it was dropped because the queue is full.  Throws
+     if the message can't be copied. */
+  bool push(const void * message);
+
+  Stats stats() const;
+
+private:
+  struct Slot
+  {
+    /* sequence number of the queue position the slot is ready for: pos if it is free for the
+       producer of position pos, pos + 1 once the message for position pos is in it */
+    std::atomic<size_t> seq;
+    void * message;
+    /* false if copying the message into the slot failed, the worker then skips it */
+    bool valid;
+  };
+
+  AsyncPublishQueue(
+    const rmw_cyclonedds_cpp::BaseDeepCopier * copier, size_t depth, bool block_when_full,
+    PublishFn publish);
+
+  void worker();
+  bool publish_one();
+  /* waits until the slot has been freed for position pos (or taken by another producer) */
+  void wait_for_slot(const Slot * slot, size_t pos);
+
+  const rmw_cyclonedds_cpp::BaseDeepCopier * m_copier;
+  const bool m_block_when_full;
+  const PublishFn m_publish;
+  const size_t m_mask;
+  std::unique_ptr<Slot[]> m_slots;
+  std::atomic<size_t> m_enqueue_pos;
+  /* only touched by the worker, m_dequeued publishes its progress to producers */
+  size_t m_dequeue_pos;
+  std::atomic<size_t> m_dequeued;
+
+  std::atomic<uint64_t> m_published;
+  std::atomic<uint64_t> m_dropped;
+  std::atomic<uint64_t> m_failed;
+  std::atomic<size_t> m_high_water_mark;
+
+  /* the worker sleeps only when the queue is empty, producers need to take the lock only when
+     it is sleeping; likewise producers only sleep (on m_space_cond) when the queue is full and
+     they have to wait for a slot, and the worker only takes the lock when some are waiting */
+  std::mutex m_lock;
+  std::condition_variable m_cond;
+  std::atomic<bool> m_sleeping;
+  std::condition_variable m_space_cond;
+  std::atomic<uint32_t> m_waiting_producers;
+  bool m_stop;
+  std::thread m_worker;
+};
+
+#endif  // ASYNC_PUBLISH_QUEUE_HPP_
@@ -0,0 +1,32 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ENV_FLAG_HPP_
+#define ENV_FLAG_HPP_
+
+#include <cstring>
+
+#include "rcutils/get_env.h"
+
+/* Whether the environment variable name is set to 1 or true, for opting in to optional
+   behaviour; callers normally look it up once and cache the result */
+inline bool env_flag(const char * name)
+{
+  const char * value;
+  if (rcutils_get_env(name, &value) != nullptr) {
+    return false;
+  }
+  return strcmp(value, "1") == 0 || strcmp(value, "true") == 0;
+}
+
+#endif  // ENV_FLAG_HPP_
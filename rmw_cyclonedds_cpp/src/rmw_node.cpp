@@ -12,7 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
@@ -26,6 +29,7 @@
 #include <tuple>
 #include <utility>
 #include <regex>
+#include <cinttypes>
 
 #include "rcutils/filesystem.h"
 #include "rcutils/format_string.h"
@@ -50,8 +54,11 @@
 #include "rmw/impl/cpp/macros.hpp"
 #include "rmw/impl/cpp/key_value.hpp"
 
+#include "ContentFilter.hpp"
+#include "DeepCopy.hpp"
 #include "TypeSupport2.hpp"
 
+#include "rmw_cyclonedds_cpp/extensions.h"
 #include "rmw_cyclonedds_cpp/rmw_version_test.hpp"
 #include "rmw_cyclonedds_cpp/MessageTypeSupport.hpp"
 #include "rmw_cyclonedds_cpp/ServiceTypeSupport.hpp"
@@ -71,7 +78,11 @@
 #include "dds/dds.h"
 #include "dds/ddsi/ddsi_sertopic.h"
 #include "rmw_cyclonedds_cpp/serdes.hpp"
+#include "async_publish_queue.hpp"
+#include "env_flag.hpp"
 #include "serdata.hpp"
+#include "serialized_buffer_pool.hpp"
+#include "shm_transport.hpp"
 #include "demangle.hpp"
 
 /* Security must be enabled when compiling and requires cyclone to support QOS property lists */
@@ -88,6 +99,30 @@
 /* Set to != 0 for periodically printing requests that have been blocked for more than 1s */
 #define REPORT_BLOCKED_REQUESTS 0
 
+/* Samples that serialize to at least this many bytes are not serialized into a single buffer
+   when published by a best-effort, volatile publisher, instead DDSI gets the serialized bytes
+   fragment by fragment as it needs them.  Other publishers keep the sample in the writer
+   history, so it would end up in a single buffer anyway. */
+#define STREAMING_SERIALIZATION_THRESHOLD (1024 * 1024)
+
+/* Maximum number of unused buffers kept by a publisher for pooled serialized messages */
+#define SERIALIZED_BUFFER_POOL_SIZE 16
+
+/* Maximum number of unused messages kept by a publisher or subscription for loans of types
+   that can't be lent out in a serialized buffer */
+#define LOANED_MESSAGE_POOL_SIZE 8
+
+/* Maximum number of samples a subscription takes from the reader at once, the remainder is
+   handed out by subsequent takes without going back to the reader.  A KEEP_LAST subscription
+   takes at most its history depth at once, as samples taken from the reader no longer get
+   replaced by newer ones: that way, it never has more than twice the depth queued, and a
+   depth of 1 still means only the latest sample is ever delivered. */
+#define TAKE_PREFETCH_COUNT 16
+
+/* Maximum number of writers a subscription in change-only mode remembers the last sample of;
+   when exceeded, it forgets all of them (at worst delivering a few repeats) */
+#define CHANGE_ONLY_MAX_WRITERS 256
+
 #define RET_ERR_X(msg, code) do {RMW_SET_ERROR_MSG(msg); code;} while (0)
 #define RET_NULL_X(var, code) do {if (!var) {RET_ERR_X(#var " is null", code);}} while (0)
 #define RET_ALLOC_X(var, code) do {if (!var) {RET_ERR_X("failed to allocate " #var, code);} \
@@ -149,11 +184,16 @@ static rmw_subscription_t * create_subscription(
   const rmw_subscription_options_t * subscription_options
 );
 static rmw_ret_t destroy_subscription(rmw_subscription_t * subscription);
+static void return_subscription_loan(
+  CddsSubscription * sub, void * loaned_message,
+  struct ddsi_serdata * d);
+static void drop_prefetched(CddsSubscription * sub);
 
 static rmw_guard_condition_t * create_guard_condition(rmw_context_impl_t * impl);
 static rmw_ret_t destroy_guard_condition(rmw_guard_condition_t * gc);
 
 struct CddsDomain;
+struct CddsPublisher;
 struct CddsWaitset;
 
 struct Cdds
@@ -169,13 +209,44 @@ struct Cdds
      entities are attached to a waitset */
   dds_entity_t gc_for_empty_waitset;
 
-  /* set of waitsets protected by lock, used to invalidate all waitsets caches when an entity is
-     deleted */
+  /* set of waitsets protected by lock, gc_for_empty_waitset exists while it is non-empty */
   std::unordered_set<CddsWaitset *> waitsets;
 
+  /* Cyclone only supports write batching for all writers at once, so while a publisher
+     batches, writes to all other publishers get flushed immediately.  It is enabled while there
+     are batching publishers or calls to rmw_cyclonedds_publish_many in progress, counted by
+     write_batching_users (protected by batch_lock); write_batching is set before it is enabled
+     in Cyclone and cleared after it has been disabled, write_batching_enables is incremented
+     before it is enabled. */
+  std::atomic<bool> write_batching;
+  std::atomic<uint32_t> write_batching_enables;
+  uint32_t write_batching_users;
+
+  /* batching publishers, for flushing those with a maximum delay from batch_flusher; protected
+     by batch_lock, as are the batching state of the publishers */
+  std::mutex batch_lock;
+  std::condition_variable batch_cond;
+  std::unordered_set<CddsPublisher *> batching_publishers;
+  std::thread batch_flusher;
+  bool batch_flusher_stop;
+
   Cdds()
-  : gc_for_empty_waitset(0)
+  : gc_for_empty_waitset(0), write_batching(false), write_batching_enables(0),
+    write_batching_users(0),
+    batch_flusher_stop(false)
   {}
+
+  ~Cdds()
+  {
+    {
+      std::lock_guard<std::mutex> lock(batch_lock);
+      batch_flusher_stop = true;
+    }
+    batch_cond.notify_all();
+    if (batch_flusher.joinable()) {
+      batch_flusher.join();
+    }
+  }
 };
 
 static Cdds gcdds;
@@ -185,6 +256,15 @@ struct CddsEntity
   dds_entity_t enth;
 };
 
+/* The waitsets a subscription or guard condition is attached to, so that deleting it needs to
+   touch only those; shared with the slots of the waitsets, as they may outlive the entity.  The
+   lock is taken before that of a waitset. */
+struct CddsWaitsetRefs
+{
+  std::mutex lock;
+  std::vector<CddsWaitset *> waitsets;
+};
+
 #if RMW_SUPPORT_SECURITY
 struct dds_security_files_t
 {
@@ -295,17 +375,159 @@ struct CddsNode
 {
 };
 
+/* Token bucket limiting the rate at which a publisher writes data; the bucket may go into debt
+   so that samples larger than the burst size still get through, just later */
+struct RateShaper
+{
+  std::mutex lock;
+  double bytes_per_ns;
+  double burst;
+  double tokens;
+  dds_time_t last;
+
+  RateShaper(uint64_t bytes_per_sec, uint64_t burst_bytes)
+  : bytes_per_ns(static_cast<double>(bytes_per_sec) / 1e9),
+    burst(static_cast<double>(burst_bytes)), tokens(static_cast<double>(burst_bytes)),
+    last(dds_time())
+  {}
+
+  /* Takes size bytes worth of tokens and sets *delay to how long the caller must wait before
+     writing them, unless that is longer than max_delay: then it takes nothing and returns
+     false */
+  bool reserve(size_t size, dds_duration_t max_delay, dds_duration_t * delay)
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    const dds_time_t tnow = dds_time();
+    if (tnow > last) {
+      tokens = std::min(burst, tokens + static_cast<double>(tnow - last) * bytes_per_ns);
+      last = tnow;
+    }
+    const double left = tokens - static_cast<double>(size);
+    const double wait = (left >= 0) ? 0.0 : -left / bytes_per_ns;
+    if (wait > static_cast<double>(max_delay)) {
+      return false;
+    }
+    tokens = left;
+    *delay = static_cast<dds_duration_t>(wait);
+    return true;
+  }
+};
+
 struct CddsPublisher : CddsEntity
 {
   dds_instance_handle_t pubiid;
   rmw_gid_t gid;
   struct ddsi_sertopic * sertopic;
+  /* participant GUID, for recognizing subscriptions in the same process */
+  dds_guid_t ppant_guid;
+  /* serialized size from which samples are serialized on demand, SIZE_MAX if never */
+  size_t streaming_threshold {SIZE_MAX};
+  /* whether all matched subscriptions are in the same participant, resp. can read samples from
+     shared memory on this host, resp. accept the native flat representation, valid as long as
+     the matched counts haven't changed */
+  std::mutex matched_lock;
+  uint32_t matched_total_count;
+  uint32_t matched_current_count;
+  bool matched_all_local;
+  bool matched_all_shm;
+  bool matched_all_flat;
+  /* layout hash subscriptions must advertise for the native flat representation to be used,
+     empty if it is disabled, as it always is for durable data */
+  std::string flat_layout;
+  /* the shared-memory ring is created on first use; it is never used for durable data, as a
+     late-joining subscription would get descriptors of samples that have long been overwritten */
+  bool shm_allowed;
+  std::mutex shm_lock;
+  std::unique_ptr<ShmWriter> shm_writer;
+  /* whether writes are left for rmw_cyclonedds_flush_publisher (or the flusher thread, if
+     batch_max_delay is finite) to flush; batch_pending_since is the time of the oldest write
+     not yet flushed, 0 if there is none */
+  std::atomic<bool> batching;
+  dds_duration_t batch_max_delay;
+  dds_time_t batch_pending_since;
+  /* if set, rmw_publish only queues a copy of the message; accessed using std::atomic_load and
+     std::atomic_store so it can be replaced while publishing.  Those take a lock in some
+     implementations, so has_async_queue tells whether it is worth looking. */
+  std::shared_ptr<AsyncPublishQueue> async_queue;
+  std::atomic<bool> has_async_queue {false};
+  /* whether a write that times out because the writer history is full, or that would have to
+     wait longer than max_blocking for the rate limit, is dropped rather than reported as an
+     error (see rmw_cyclonedds_publisher_options_t), and the number of writes either way */
+  bool drop_when_full;
+  dds_duration_t max_blocking {DDS_INFINITY};
+  std::atomic<uint64_t> writes_would_block;
+  std::atomic<uint64_t> writes_dropped;
+  /* if set, writes are paced to the configured rate; accessed using std::atomic_load and
+     std::atomic_store, after checking has_shaper; the statistics cover all shapers the
+     publisher has had */
+  std::shared_ptr<RateShaper> shaper;
+  std::atomic<bool> has_shaper {false};
+  std::atomic<uint64_t> writes_shaped;
+  std::atomic<uint64_t> shaping_delay_total;
+  std::atomic<uint64_t> shaping_delay_max;
+  /* buffers for rmw_cyclonedds_init_pooled_serialized_message and loaned messages */
+  SerializedBufferPool::Ptr serialized_buffers;
+  /* messages lent out by rmw_borrow_loaned_message, keyed on the message address: for plain
+     types the message lives in the payload, right after the encapsulation header, for others
+     it comes from loan_pool (and the deleter returns it) */
+  bool loans_in_payload;
+  std::unique_ptr<rmw_cyclonedds_cpp::MessagePool> loan_pool;
+  std::mutex loans_lock;
+  std::unordered_map<void *, std::shared_ptr<byte>> loans;
 };
 
 struct CddsSubscription : CddsEntity
 {
   rmw_gid_t gid;
   dds_entity_t rdcondh;
+  struct ddsi_sertopic * sertopic;
+  /* messages lent out by rmw_take_loaned_message, keyed on the message address: either in the
+     payload of the (referenced) serdata or, if null, a message from loan_pool */
+  std::unique_ptr<rmw_cyclonedds_cpp::MessagePool> loan_pool;
+  std::mutex loans_lock;
+  std::unordered_map<void *, struct ddsi_serdata *> loans;
+  /* samples taken from the reader in a batch, of which those from prefetch_next up to
+     prefetch_count have yet to be taken by the application (see take_next_serdata); prefetched
+     is set while there are any, as rmw_wait must then not block */
+  std::mutex prefetch_lock;
+  struct ddsi_serdata * prefetch_serdata[TAKE_PREFETCH_COUNT];
+  dds_sample_info_t prefetch_infos[TAKE_PREFETCH_COUNT];
+  uint32_t prefetch_max {TAKE_PREFETCH_COUNT};
+  uint32_t prefetch_next;
+  uint32_t prefetch_count;
+  std::atomic<bool> prefetched;
+  /* whether a take returns only the newest sample available, and the number of samples
+     dropped because of it; latest_only_refills is the number of batches it takes from the
+     reader at most, enough to empty a full history */
+  std::atomic<bool> latest_only;
+  uint32_t latest_only_refills {1};
+  std::atomic<uint64_t> conflated;
+  /* decimation: at most one of every decimate_n samples is delivered, and none sooner than
+     decimate_period after the source timestamp of the last one delivered; the settings and
+     state are protected by decimate_lock, decimating is set while either is enabled */
+  std::atomic<bool> decimating;
+  std::mutex decimate_lock;
+  uint32_t decimate_n;
+  dds_duration_t decimate_period;
+  uint32_t decimate_skipped;
+  bool decimate_have_last;
+  dds_time_t decimate_last;
+  std::atomic<uint64_t> decimated;
+  /* if set, only samples it matches are delivered; accessed using std::atomic_load and
+     std::atomic_store, after checking has_content_filter */
+  std::shared_ptr<const rmw_cyclonedds_cpp::ContentFilter> content_filter;
+  std::atomic<bool> has_content_filter {false};
+  std::atomic<uint64_t> filtered;
+  /* waitsets the read condition is attached to */
+  std::shared_ptr<CddsWaitsetRefs> waitset_refs {std::make_shared<CddsWaitsetRefs>()};
+  /* change-only mode: a sample identical to the previous one from the same writer is dropped;
+     change_only_last maps the writer to the size and hash of that sample and is protected by
+     change_only_lock */
+  std::atomic<bool> change_only;
+  std::mutex change_only_lock;
+  std::unordered_map<dds_instance_handle_t, std::pair<size_t, uint64_t>,
+    dds_instance_handle_hash> change_only_last;
+  std::atomic<uint64_t> suppressed;
 };
 
 struct CddsCS
@@ -333,6 +555,7 @@ struct CddsService
 struct CddsGuardCondition
 {
   dds_entity_t gcondh;
+  std::shared_ptr<CddsWaitsetRefs> waitset_refs {std::make_shared<CddsWaitsetRefs>()};
 };
 
 struct CddsEvent : CddsEntity
@@ -340,23 +563,58 @@ struct CddsEvent : CddsEntity
   rmw_event_type_t event_type;
 };
 
+/* A condition attached to a waitset, the index of the slot is the attach argument */
+struct CddsWaitsetSlot
+{
+  /* 0 for a free slot */
+  dds_entity_t cond;
+  /* value of the waitset's gen when last passed to rmw_wait */
+  uint64_t gen;
+  /* the waitsets of the entity owning cond, null for the entity of an event: those get detached
+     by Cyclone when deleted, and aren't cached by address */
+  std::shared_ptr<CddsWaitsetRefs> refs;
+  /* for the entity of an event: the status mask last set (if status_mask_set), and the one
+     being built up for the current call (if status_mask_gen is the waitset's gen) */
+  bool status_mask_set;
+  uint32_t status_mask;
+  uint64_t status_mask_gen;
+  uint32_t new_status_mask;
+};
+
 struct CddsWaitset
 {
   dds_entity_t waitseth;
 
   std::vector<dds_attach_t> trigs;
-  size_t nelems;
 
   std::mutex lock;
   bool inuse;
+  /* entities passed to the previous call to rmw_wait: if the same ones are passed again, the
+     waitset is good as it is */
   std::vector<CddsSubscription *> subs;
   std::vector<CddsGuardCondition *> gcs;
   std::vector<CddsClient *> cls;
   std::vector<CddsService *> srvs;
   std::vector<CddsEvent> evs;
+
+  /* attached conditions: attached maps the condition to its slot, entry_slots has the slot of
+     each of the subscriptions, guard conditions, services and clients (in that order) of the
+     previous call, and triggered is a bitmap of the slots of triggered conditions (only set
+     during rmw_wait) */
+  uint64_t gen;
+  std::vector<CddsWaitsetSlot> slots;
+  std::vector<size_t> free_slots;
+  std::unordered_map<dds_entity_t, size_t> attached;
+  std::vector<size_t> entry_slots;
+  std::vector<uint64_t> triggered;
+  /* slots of the entities of events in the current call */
+  std::vector<size_t> event_slots;
 };
 
-static void clean_waitset_caches();
+static void detach_from_waitsets(
+  const std::shared_ptr<CddsWaitsetRefs> & refs,
+  dds_entity_t cond);
+static void waitset_detach(CddsWaitset * ws);
 #if REPORT_BLOCKED_REQUESTS
 static void check_for_blocked_requests(CddsClient & client);
 #endif
@@ -1319,184 +1577,954 @@ static dds_entity_t create_topic(dds_entity_t pp, struct ddsi_sertopic * sertopi
 ///////////                                                                   ///////////
 /////////////////////////////////////////////////////////////////////////////////////////
 
-extern "C" rmw_ret_t rmw_publish(
-  const rmw_publisher_t * publisher, const void * ros_message,
-  rmw_publisher_allocation_t * allocation)
+static void batch_flusher_thread()
 {
-  static_cast<void>(allocation);    // unused
-  RET_WRONG_IMPLID(publisher);
-  RET_NULL(ros_message);
-  auto pub = static_cast<CddsPublisher *>(publisher->data);
-  assert(pub);
-  if (dds_write(pub->enth, ros_message) >= 0) {
-    return RMW_RET_OK;
-  } else {
-    RMW_SET_ERROR_MSG("failed to publish data");
-    return RMW_RET_ERROR;
+  std::unique_lock<std::mutex> lock(gcdds.batch_lock);
+  while (!gcdds.batch_flusher_stop) {
+    const dds_time_t tnow = dds_time();
+    dds_time_t next = DDS_NEVER;
+    for (auto pub : gcdds.batching_publishers) {
+      if (pub->batch_pending_since == 0 || pub->batch_max_delay == DDS_INFINITY) {
+        continue;
+      }
+      const dds_time_t deadline = pub->batch_pending_since + pub->batch_max_delay;
+      if (deadline <= tnow) {
+        pub->batch_pending_since = 0;
+        static_cast<void>(dds_write_flush(pub->enth));
+      } else if (deadline < next) {
+        next = deadline;
+      }
+    }
+    if (next == DDS_NEVER) {
+      gcdds.batch_cond.wait(lock);
+    } else {
+      gcdds.batch_cond.wait_for(lock, std::chrono::nanoseconds(next - tnow));
+    }
   }
 }
 
-extern "C" rmw_ret_t rmw_publish_serialized_message(
-  const rmw_publisher_t * publisher,
-  const rmw_serialized_message_t * serialized_message, rmw_publisher_allocation_t * allocation)
+/* Adds resp. removes a user of write batching, enabling resp. disabling it in Cyclone for the
+   first resp. last one; the caller must hold batch_lock */
+static void write_batching_ref()
 {
-  static_cast<void>(allocation);    // unused
-  RET_WRONG_IMPLID(publisher);
-  RET_NULL(serialized_message);
-  auto pub = static_cast<CddsPublisher *>(publisher->data);
-  struct ddsi_serdata * d = serdata_rmw_from_serialized_message(
-    pub->sertopic, serialized_message->buffer, serialized_message->buffer_length);
-  const bool ok = (dds_writecdr(pub->enth, d) >= 0);
-  return ok ? RMW_RET_OK : RMW_RET_ERROR;
+  if (gcdds.write_batching_users++ == 0) {
+    gcdds.write_batching_enables++;
+    gcdds.write_batching.store(true);
+    dds_write_set_batch(true);
+  }
 }
 
-extern "C" rmw_ret_t rmw_publish_loaned_message(
-  const rmw_publisher_t * publisher,
-  void * ros_message,
-  rmw_publisher_allocation_t * allocation)
+static void write_batching_unref()
 {
-  (void) publisher;
-  (void) ros_message;
-  (void) allocation;
+  if (--gcdds.write_batching_users == 0) {
+    dds_write_set_batch(false);
+    gcdds.write_batching.store(false);
+  }
+}
 
-  RMW_SET_ERROR_MSG("rmw_publish_loaned_message not implemented for rmw_cyclonedds_cpp");
-  return RMW_RET_UNSUPPORTED;
+/* Whether write batching is enabled and how often it has been, read before writing */
+struct write_batching_state
+{
+  bool enabled;
+  uint32_t enables;
+};
+
+static write_batching_state get_write_batching_state()
+{
+  return {gcdds.write_batching.load(), gcdds.write_batching_enables.load()};
 }
 
-static const rosidl_message_type_support_t * get_typesupport(
-  const rosidl_message_type_support_t * type_supports)
+/* Completes writing to a publisher: flushes it, unless it batches, in which case it only makes
+   sure the flusher thread knows there is something to flush.  before is the state of write
+   batching read before writing: the write may have been batched if it was enabled then or is
+   now, or if it has been enabled (and possibly disabled again) in the meantime. */
+static void after_write(CddsPublisher * pub, const write_batching_state & before)
 {
-  const rosidl_message_type_support_t * ts;
-  if ((ts =
-    get_message_typesupport_handle(
-      type_supports, rosidl_typesupport_introspection_c__identifier)) != nullptr)
-  {
-    return ts;
+  if (!pub->batching.load()) {
+    const write_batching_state now = get_write_batching_state();
+    if (before.enabled || now.enabled || now.enables != before.enables) {
+      static_cast<void>(dds_write_flush(pub->enth));
+    }
   } else {
-    if ((ts =
-      get_message_typesupport_handle(
-        type_supports, rosidl_typesupport_introspection_cpp::typesupport_identifier)) != nullptr)
-    {
-      return ts;
+    std::lock_guard<std::mutex> lock(gcdds.batch_lock);
+    if (pub->batch_pending_since == 0 && pub->batch_max_delay != DDS_INFINITY) {
+      pub->batch_pending_since = dds_time();
+      gcdds.batch_cond.notify_all();
+    }
+  }
+}
+
+/* Delays writing a serdata as required by the rate limit of the publisher, if any.  Only data
+   that goes over the network counts: a copy of the sample for readers in this process or a
+   descriptor of one in shared memory doesn't.  Returns false, with *ret set to the result of
+   publishing, if the serdata mustn't be written because the publisher can't wait that long. */
+static bool shape_write(CddsPublisher * pub, const struct ddsi_serdata * dcmn, rmw_ret_t * ret)
+{
+  if (!pub->has_shaper.load(std::memory_order_relaxed)) {
+    return true;
+  }
+  auto shaper = std::atomic_load(&pub->shaper);
+  if (shaper == nullptr) {
+    return true;
+  }
+  auto d = static_cast<const serdata_rmw *>(dcmn);
+  if (d->native_sample() != nullptr ||
+    (!d->is_streaming() && shm_is_descriptor(d->data(), d->size())))
+  {
+    return true;
+  }
+  dds_duration_t delay;
+  if (!shaper->reserve(d->size(), pub->max_blocking, &delay)) {
+    if (pub->drop_when_full) {
+      pub->writes_dropped++;
+      *ret = RMW_RET_OK;
     } else {
-      RMW_SET_ERROR_MSG("type support not from this implementation");
-      return nullptr;
+      pub->writes_would_block++;
+      RMW_SET_ERROR_MSG("rate limit exceeded");
+      *ret = RMW_RET_TIMEOUT;
+    }
+    return false;
+  }
+  if (delay > 0) {
+    const uint64_t udelay = static_cast<uint64_t>(delay);
+    pub->writes_shaped++;
+    pub->shaping_delay_total += udelay;
+    uint64_t max = pub->shaping_delay_max.load();
+    while (udelay > max && !pub->shaping_delay_max.compare_exchange_weak(max, udelay)) {
     }
+    dds_sleepfor(delay);
   }
+  return true;
 }
 
-static std::string make_fqtopic(
-  const char * prefix, const char * topic_name, const char * suffix,
-  bool avoid_ros_namespace_conventions)
+/* Converts the result of a write, a write that timed out because the writer history is full
+   and the readers don't acknowledge the data quickly enough is either dropped or an error */
+static rmw_ret_t write_result(CddsPublisher * pub, dds_return_t ret)
 {
-  if (avoid_ros_namespace_conventions) {
-    return std::string(topic_name) + "__" + std::string(suffix);
+  if (ret >= 0) {
+    return RMW_RET_OK;
+  } else if (ret == DDS_RETCODE_TIMEOUT) {
+    if (pub->drop_when_full) {
+      pub->writes_dropped++;
+      return RMW_RET_OK;
+    }
+    pub->writes_would_block++;
+    RMW_SET_ERROR_MSG("writer history is full");
+    return RMW_RET_TIMEOUT;
   } else {
-    return std::string(prefix) + std::string(topic_name) + std::string(suffix);
+    RMW_SET_ERROR_MSG("failed to publish data");
+    return RMW_RET_ERROR;
   }
 }
 
-static std::string make_fqtopic(
-  const char * prefix, const char * topic_name, const char * suffix,
-  const rmw_qos_profile_t * qos_policies)
+/* Hands a serdata to DDSI, consuming the reference */
+static rmw_ret_t write_serdata(CddsPublisher * pub, struct ddsi_serdata * d)
 {
-  return make_fqtopic(prefix, topic_name, suffix, qos_policies->avoid_ros_namespace_conventions);
+  rmw_ret_t ret;
+  if (!shape_write(pub, d, &ret)) {
+    ddsi_serdata_unref(d);
+    return ret;
+  }
+  const write_batching_state write_batching = get_write_batching_state();
+  ret = write_result(pub, dds_writecdr(pub->enth, d));
+  if (ret == RMW_RET_OK) {
+    after_write(pub, write_batching);
+  }
+  return ret;
 }
 
-static dds_qos_t * create_readwrite_qos(
-  const rmw_qos_profile_t * qos_policies,
-  bool ignore_local_publications)
+static void set_batching(CddsPublisher * pub, bool enable, dds_duration_t max_delay)
 {
-  dds_duration_t ldur;
-  dds_qos_t * qos = dds_create_qos();
-  dds_qset_writer_data_lifecycle(qos, false); /* disable autodispose */
-  switch (qos_policies->history) {
-    case RMW_QOS_POLICY_HISTORY_SYSTEM_DEFAULT:
-    case RMW_QOS_POLICY_HISTORY_UNKNOWN:
-    case RMW_QOS_POLICY_HISTORY_KEEP_LAST:
-      if (qos_policies->depth == RMW_QOS_POLICY_DEPTH_SYSTEM_DEFAULT) {
-        dds_qset_history(qos, DDS_HISTORY_KEEP_LAST, 1);
-      } else {
-        if (qos_policies->depth < 1 || qos_policies->depth > INT32_MAX) {
-          RMW_SET_ERROR_MSG("unsupported history depth");
-          dds_delete_qos(qos);
-          return nullptr;
-        }
-        dds_qset_history(qos, DDS_HISTORY_KEEP_LAST, static_cast<int32_t>(qos_policies->depth));
+  {
+    std::lock_guard<std::mutex> lock(gcdds.batch_lock);
+    if (enable && !pub->batching.load()) {
+      write_batching_ref();
+    }
+    pub->batch_max_delay = max_delay;
+    pub->batch_pending_since = 0;
+    pub->batching.store(enable);
+    if (enable) {
+      gcdds.batching_publishers.insert(pub);
+      if (max_delay != DDS_INFINITY && !gcdds.batch_flusher.joinable()) {
+        gcdds.batch_flusher = std::thread(batch_flusher_thread);
       }
-      break;
+    } else if (gcdds.batching_publishers.erase(pub) > 0) {
+      write_batching_unref();
+    }
+  }
+  gcdds.batch_cond.notify_all();
+  static_cast<void>(dds_write_flush(pub->enth));
+}
+
+/* Whether the native flat representation may be used, for types that have the same layout in
+   all peers */
+static bool native_flat_enabled()
+{
+  static const bool enabled = env_flag("RMW_CYCLONEDDS_NATIVE_FLAT");
+  return enabled;
+}
+
+/* Whether publishers and subscriptions of types that can't be lent out in the serialized
+   payload advertise loans anyway.  For those, a loan is a message from a pool rather than a
+   saving of copying or (de)serializing, so it is opt-in: rclcpp uses loaned takes for every
+   subscription that advertises them. */
+static bool pooled_loans_enabled()
+{
+  static const bool enabled = env_flag("RMW_CYCLONEDDS_POOLED_LOANS");
+  return enabled;
+}
+
+/* Whether entities of the type advertise loans */
+static bool can_loan_messages(const struct ddsi_sertopic * sertopic)
+{
+  auto st = static_cast<const struct sertopic_rmw *>(sertopic);
+  return st->cdr_writer->is_plain() || pooled_loans_enabled();
+}
+
+static std::string flat_layout_of(const struct ddsi_sertopic * sertopic)
+{
+  auto st = static_cast<const struct sertopic_rmw *>(sertopic);
+  if (!native_flat_enabled() || st->copier == nullptr) {
+    return "";
+  }
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016" PRIx64, st->copier->layout_hash());
+  return buf;
+}
+
+/* True if a subscription with the given QoS can't hold more samples than the shared-memory ring
+   of a publisher: otherwise, a reliable subscription could lose samples it has received */
+static bool shm_history_fits(const rmw_qos_profile_t * qos_policies)
+{
+  switch (qos_policies->history) {
     case RMW_QOS_POLICY_HISTORY_KEEP_ALL:
-      dds_qset_history(qos, DDS_HISTORY_KEEP_ALL, DDS_LENGTH_UNLIMITED);
-      break;
+      return false;
     default:
-      rmw_cyclonedds_cpp::unreachable();
+      return qos_policies->depth == RMW_QOS_POLICY_DEPTH_SYSTEM_DEFAULT ||
+             qos_policies->depth <= shm_max_history_depth();
   }
-  switch (qos_policies->reliability) {
-    case RMW_QOS_POLICY_RELIABILITY_SYSTEM_DEFAULT:
-    case RMW_QOS_POLICY_RELIABILITY_UNKNOWN:
-    case RMW_QOS_POLICY_RELIABILITY_RELIABLE:
-      dds_qset_reliability(qos, DDS_RELIABILITY_RELIABLE, DDS_INFINITY);
-      break;
-    case RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT:
-      dds_qset_reliability(qos, DDS_RELIABILITY_BEST_EFFORT, 0);
-      break;
-    default:
-      rmw_cyclonedds_cpp::unreachable();
+}
+
+/* True if the key-value pairs in the user data of a matched subscription include key=value */
+static bool user_data_has(
+  const std::map<std::string, std::vector<uint8_t>> & map,
+  const char * key, const std::string & value)
+{
+  auto found = map.find(key);
+  return found != map.end() && std::string(found->second.begin(), found->second.end()) == value;
+}
+
+/* Determines whether the publisher has matched subscriptions and all of them are in its own
+   participant, whether all of them can read from its shared memory and whether all of them
+   accept the native flat representation.  The matched subscriptions only get inspected when the
+   matched counts change. */
+static void check_matched_subscriptions(
+  CddsPublisher * pub, bool * all_local, bool * all_shm,
+  bool * all_flat)
+{
+  dds_publication_matched_status_t status;
+  *all_local = *all_shm = *all_flat = false;
+  if (dds_get_publication_matched_status(pub->enth, &status) < 0) {
+    return;
   }
-  switch (qos_policies->durability) {
-    case RMW_QOS_POLICY_DURABILITY_SYSTEM_DEFAULT:
-    case RMW_QOS_POLICY_DURABILITY_UNKNOWN:
-    case RMW_QOS_POLICY_DURABILITY_VOLATILE:
-      dds_qset_durability(qos, DDS_DURABILITY_VOLATILE);
-      break;
-    case RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL: {
-        /* Cyclone uses durability service QoS for determining what to retain as historical data,
-           separating the reliability window from the historical data; but that is somewhat unusual
-           among DDS implementations ... */
-        dds_history_kind_t hk;
-        int32_t hd;
-        dds_qget_history(qos, &hk, &hd);
-        dds_qset_durability(qos, DDS_DURABILITY_TRANSIENT_LOCAL);
-        dds_qset_durability_service(
-          qos, DDS_SECS(0), hk, hd, DDS_LENGTH_UNLIMITED, DDS_LENGTH_UNLIMITED,
-          DDS_LENGTH_UNLIMITED);
+  std::lock_guard<std::mutex> lock(pub->matched_lock);
+  if (status.total_count != pub->matched_total_count ||
+    status.current_count != pub->matched_current_count)
+  {
+    std::vector<dds_instance_handle_t> rds(status.current_count);
+    const dds_return_t n = dds_get_matched_subscriptions(pub->enth, rds.data(), rds.size());
+    /* a subscription that matched in the meantime makes the counts differ next time */
+    bool local = (n > 0 && static_cast<size_t>(n) <= rds.size());
+    bool shm = local && pub->shm_allowed;
+    bool flat = local && !pub->flat_layout.empty();
+    for (dds_return_t i = 0; (local || shm || flat) && i < n; i++) {
+      dds_builtintopic_endpoint_t * ep = dds_get_matched_subscription_data(pub->enth, rds[i]);
+      if (ep == nullptr) {
+        local = shm = flat = false;
         break;
       }
-    default:
-      rmw_cyclonedds_cpp::unreachable();
-  }
-  if (qos_policies->lifespan.sec > 0 || qos_policies->lifespan.nsec > 0) {
-    dds_qset_lifespan(qos, DDS_SECS(qos_policies->lifespan.sec) + qos_policies->lifespan.nsec);
+      local = local &&
+        memcmp(&ep->participant_key, &pub->ppant_guid, sizeof(pub->ppant_guid)) == 0;
+      void * ud;
+      size_t udsz;
+      if ((shm || flat) && dds_qget_userdata(ep->qos, &ud, &udsz)) {
+        std::vector<uint8_t> udvec(static_cast<uint8_t *>(ud), static_cast<uint8_t *>(ud) + udsz);
+        dds_free(ud);
+        auto map = rmw::impl::cpp::parse_key_value(udvec);
+        shm = shm && user_data_has(map, "shm", shm_host_id());
+        flat = flat && user_data_has(map, "flat", pub->flat_layout);
+      } else {
+        shm = flat = false;
+      }
+      dds_builtintopic_free_endpoint(ep);
+    }
+    pub->matched_total_count = status.total_count;
+    pub->matched_current_count = status.current_count;
+    pub->matched_all_local = local;
+    pub->matched_all_shm = shm;
+    pub->matched_all_flat = flat;
+  }
+  *all_local = pub->matched_all_local;
+  *all_shm = pub->matched_all_shm;
+  *all_flat = pub->matched_all_flat;
+}
+
+/* Serializes the sample (in CDR or, if flat is set, in the native flat representation) into the
+   publisher's shared memory and returns a serdata holding the descriptor, or null if the
+   sample doesn't fit or the shared memory can't be used */
+static struct ddsi_serdata * serdata_from_sample_shm(
+  CddsPublisher * pub, const void * ros_message,
+  bool flat)
+{
+  auto st = static_cast<const struct sertopic_rmw *>(pub->sertopic);
+  std::lock_guard<std::mutex> lock(pub->shm_lock);
+  if (pub->shm_writer == nullptr) {
+    if ((pub->shm_writer = ShmWriter::create(pub->pubiid)) == nullptr) {
+      RCUTILS_LOG_WARN_NAMED(
+        "rmw_cyclonedds_cpp", "failed to create shared memory segment, not using shared memory");
+      std::lock_guard<std::mutex> matched_lock(pub->matched_lock);
+      pub->shm_allowed = false;
+      pub->matched_all_shm = false;
+      return nullptr;
+    }
   }
-  if (qos_policies->deadline.sec > 0 || qos_policies->deadline.nsec > 0) {
-    dds_qset_deadline(qos, DDS_SECS(qos_policies->deadline.sec) + qos_policies->deadline.nsec);
+  try {
+    const size_t size =
+      flat ? st->copier->flat_size(ros_message) : st->cdr_writer->get_serialized_size(ros_message);
+    std::vector<byte> descriptor(ShmWriter::descriptor_size());
+    void * slot;
+    if ((slot = pub->shm_writer->begin_write(size)) == nullptr) {
+      return nullptr;
+    }
+    try {
+      if (flat) {
+        st->copier->flatten(slot, ros_message);
+      } else {
+        st->cdr_writer->serialize(slot, ros_message);
+      }
+    } catch (...) {
+      pub->shm_writer->end_write(nullptr);
+      throw;
+    }
+    pub->shm_writer->end_write(descriptor.data());
+    return serdata_rmw_from_serialized_message(
+      pub->sertopic, descriptor.data(), descriptor.size());
+  } catch (std::exception &) {
+    /* the usual path reports the error, if it wasn't a problem with the shared memory */
+    return nullptr;
   }
+}
 
-  if (qos_policies->liveliness_lease_duration.sec == 0 &&
-    qos_policies->liveliness_lease_duration.nsec == 0)
-  {
-    ldur = DDS_INFINITY;
+/* Publishes a sample in the form suited to the matched subscriptions; completing the write (see
+   after_write) is left to the caller */
+static rmw_ret_t publish_sample(
+  CddsPublisher * pub, const void * ros_message,
+  bool all_local, bool all_shm, bool all_flat)
+{
+  struct ddsi_serdata * d;
+  if (all_local) {
+    /* readers in this process get a deep copy, no need to serialize unless DDSI asks for it */
+    d = serdata_rmw_from_sample_native(pub->sertopic, ros_message);
+  } else if (all_shm && (d = serdata_from_sample_shm(pub, ros_message, all_flat)) != nullptr) {
+    /* readers on this host get a descriptor of the sample in shared memory */
+  } else if (all_flat) {
+    /* readers with the same layout of the type get it in (nearly) its in-memory form */
+    d = serdata_rmw_from_sample_flat(pub->sertopic, ros_message);
   } else {
-    ldur = DDS_SECS(qos_policies->liveliness_lease_duration.sec) +
-      qos_policies->liveliness_lease_duration.nsec;
+    d = serdata_rmw_from_sample_streaming(pub->sertopic, ros_message, pub->streaming_threshold);
   }
-  switch (qos_policies->liveliness) {
-    case RMW_QOS_POLICY_LIVELINESS_SYSTEM_DEFAULT:
-    case RMW_QOS_POLICY_LIVELINESS_AUTOMATIC:
-    case RMW_QOS_POLICY_LIVELINESS_UNKNOWN:
-      dds_qset_liveliness(qos, DDS_LIVELINESS_AUTOMATIC, ldur);
-      break;
-    case RMW_QOS_POLICY_LIVELINESS_MANUAL_BY_NODE:
-      dds_qset_liveliness(qos, DDS_LIVELINESS_MANUAL_BY_PARTICIPANT, ldur);
-      break;
-    case RMW_QOS_POLICY_LIVELINESS_MANUAL_BY_TOPIC:
-      dds_qset_liveliness(qos, DDS_LIVELINESS_MANUAL_BY_TOPIC, ldur);
-      break;
+  if (d == nullptr) {
+    return RMW_RET_ERROR;
   }
-  if (ignore_local_publications) {
-    dds_qset_ignorelocal(qos, DDS_IGNORELOCAL_PARTICIPANT);
+  /* dds_writecdr consumes a reference, but for large samples the serdata may still refer to
+     ros_message, so hang on to it until it has been detached from ros_message */
+  rmw_ret_t shape_ret;
+  if (!shape_write(pub, d, &shape_ret)) {
+    ddsi_serdata_unref(d);
+    return shape_ret;
   }
-  return qos;
+  ddsi_serdata_ref(d);
+  const dds_return_t ret = dds_writecdr(pub->enth, d);
+  serdata_rmw_release_sample(d);
+  ddsi_serdata_unref(d);
+  return write_result(pub, ret);
+}
+
+extern "C" rmw_ret_t rmw_publish(
+  const rmw_publisher_t * publisher, const void * ros_message,
+  rmw_publisher_allocation_t * allocation)
+{
+  static_cast<void>(allocation);    // unused
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(ros_message);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  assert(pub);
+  std::shared_ptr<AsyncPublishQueue> q;
+  if (pub->has_async_queue.load(std::memory_order_relaxed) &&
+    (q = std::atomic_load(&pub->async_queue)) != nullptr)
+  {
+    /* a message dropped because the queue is full is accounted for in the statistics, the
+       caller opted for losing messages rather than blocking */
+    try {
+      static_cast<void>(q->push(ros_message));
+      return RMW_RET_OK;
+    } catch (std::exception & e) {
+      RMW_SET_ERROR_MSG(e.what());
+      return RMW_RET_ERROR;
+    }
+  }
+  bool all_local, all_shm, all_flat;
+  check_matched_subscriptions(pub, &all_local, &all_shm, &all_flat);
+  const write_batching_state write_batching = get_write_batching_state();
+  const rmw_ret_t ret = publish_sample(pub, ros_message, all_local, all_shm, all_flat);
+  if (ret == RMW_RET_OK) {
+    after_write(pub, write_batching);
+  }
+  return ret;
+}
+
+/* Whether a payload serialized for topic a can be written using topic b */
+static bool same_payload_type(const struct ddsi_sertopic * a, const struct ddsi_sertopic * b)
+{
+  auto sta = static_cast<const struct sertopic_rmw *>(a);
+  auto stb = static_cast<const struct sertopic_rmw *>(b);
+  return sta == stb ||
+         (!sta->is_request_header && !stb->is_request_header &&
+         strcmp(sta->type_name, stb->type_name) == 0);
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_publish_fanout(
+  const rmw_publisher_t * const * publishers, size_t count,
+  const void * ros_message, size_t * published)
+{
+  RET_NULL(publishers);
+  RET_NULL(ros_message);
+  if (published) {
+    *published = 0;
+  }
+  if (count == 0) {
+    return RMW_RET_OK;
+  }
+  RET_NULL(publishers[0]);
+  RET_WRONG_IMPLID(publishers[0]);
+  auto pub0 = static_cast<CddsPublisher *>(publishers[0]->data);
+  for (size_t i = 1; i < count; i++) {
+    RET_NULL(publishers[i]);
+    RET_WRONG_IMPLID(publishers[i]);
+    auto pub = static_cast<CddsPublisher *>(publishers[i]->data);
+    if (!same_payload_type(pub0->sertopic, pub->sertopic)) {
+      RMW_SET_ERROR_MSG("publishers are not of the same type");
+      return RMW_RET_INVALID_ARGUMENT;
+    }
+  }
+  struct ddsi_serdata * d = ddsi_serdata_from_sample(pub0->sertopic, SDK_DATA, ros_message);
+  if (d == nullptr) {
+    return RMW_RET_ERROR;
+  }
+  rmw_ret_t ret = RMW_RET_OK;
+  for (size_t i = 0; i < count; i++) {
+    auto pub = static_cast<CddsPublisher *>(publishers[i]->data);
+    if ((ret = write_serdata(pub, serdata_rmw_share_payload(pub->sertopic, d))) != RMW_RET_OK) {
+      break;
+    }
+    if (published) {
+      *published = i + 1;
+    }
+  }
+  ddsi_serdata_unref(d);
+  return ret;
+}
+
+struct rmw_cyclonedds_prepared_message_t
+{
+  struct ddsi_sertopic * sertopic;
+  struct ddsi_serdata * serdata;
+};
+
+extern "C" rmw_ret_t rmw_cyclonedds_prepare_message(
+  const rmw_publisher_t * publisher, const void * ros_message,
+  rmw_cyclonedds_prepared_message_t ** prepared)
+{
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(ros_message);
+  RET_NULL(prepared);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  struct ddsi_serdata * d = ddsi_serdata_from_sample(pub->sertopic, SDK_DATA, ros_message);
+  if (d == nullptr) {
+    return RMW_RET_ERROR;
+  }
+  auto p = new(std::nothrow) rmw_cyclonedds_prepared_message_t;
+  if (p == nullptr) {
+    ddsi_serdata_unref(d);
+    RMW_SET_ERROR_MSG("failed to allocate prepared message");
+    return RMW_RET_BAD_ALLOC;
+  }
+  p->sertopic = ddsi_sertopic_ref(pub->sertopic);
+  p->serdata = d;
+  *prepared = p;
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_publish_prepared_message(
+  const rmw_publisher_t * publisher,
+  const rmw_cyclonedds_prepared_message_t * prepared)
+{
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(prepared);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  if (!same_payload_type(prepared->sertopic, pub->sertopic)) {
+    RMW_SET_ERROR_MSG("message was prepared for a different type");
+    return RMW_RET_INVALID_ARGUMENT;
+  }
+  /* each write gets a serdata of its own, as the source timestamp is stored in it */
+  return write_serdata(pub, serdata_rmw_share_payload(pub->sertopic, prepared->serdata));
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_destroy_prepared_message(
+  rmw_cyclonedds_prepared_message_t * prepared)
+{
+  RET_NULL(prepared);
+  ddsi_serdata_unref(prepared->serdata);
+  ddsi_sertopic_unref(prepared->sertopic);
+  delete prepared;
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_get_publisher_write_stats(
+  const rmw_publisher_t * publisher,
+  rmw_cyclonedds_publisher_write_stats_t * stats)
+{
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(stats);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  stats->would_block = pub->writes_would_block.load();
+  stats->dropped = pub->writes_dropped.load();
+  stats->shaped = pub->writes_shaped.load();
+  stats->shaping_delay_total_ns = pub->shaping_delay_total.load();
+  stats->shaping_delay_max_ns = pub->shaping_delay_max.load();
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_set_publisher_rate_limit(
+  const rmw_publisher_t * publisher, uint64_t bytes_per_sec,
+  uint64_t burst_bytes)
+{
+  RET_WRONG_IMPLID(publisher);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  std::shared_ptr<RateShaper> shaper;
+  if (bytes_per_sec > 0) {
+    try {
+      shaper = std::make_shared<RateShaper>(bytes_per_sec, burst_bytes);
+    } catch (std::bad_alloc &) {
+      RMW_SET_ERROR_MSG("failed to allocate rate shaper");
+      return RMW_RET_BAD_ALLOC;
+    }
+  }
+  std::atomic_store(&pub->shaper, shaper);
+  pub->has_shaper.store(shaper != nullptr);
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_set_publisher_async(
+  const rmw_publisher_t * publisher,
+  const rmw_cyclonedds_async_publish_options_t * options)
+{
+  RET_WRONG_IMPLID(publisher);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  std::shared_ptr<AsyncPublishQueue> q;
+  if (options != nullptr) {
+    auto st = static_cast<const struct sertopic_rmw *>(pub->sertopic);
+    if (st->copier == nullptr) {
+      RMW_SET_ERROR_MSG("asynchronous publishing not supported for this type");
+      return RMW_RET_UNSUPPORTED;
+    }
+    if (options->queue_depth == 0) {
+      RMW_SET_ERROR_MSG("queue_depth must be positive");
+      return RMW_RET_INVALID_ARGUMENT;
+    }
+    q = AsyncPublishQueue::create(
+      st->copier.get(), options->queue_depth,
+      options->when_full == RMW_CYCLONEDDS_ASYNC_PUBLISH_BLOCK, options->worker_cpu,
+      [pub](const void * ros_message) {
+        bool all_local, all_shm, all_flat;
+        check_matched_subscriptions(pub, &all_local, &all_shm, &all_flat);
+        const write_batching_state write_batching = get_write_batching_state();
+        if (publish_sample(pub, ros_message, all_local, all_shm, all_flat) != RMW_RET_OK) {
+          return false;
+        }
+        after_write(pub, write_batching);
+        return true;
+      });
+    if (q == nullptr) {
+      return RMW_RET_ERROR;
+    }
+  }
+  /* the old queue, if any, publishes what it still holds when the last reference goes */
+  std::atomic_store(&pub->async_queue, q);
+  pub->has_async_queue.store(q != nullptr);
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_get_publisher_async_stats(
+  const rmw_publisher_t * publisher,
+  rmw_cyclonedds_async_publish_stats_t * stats)
+{
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(stats);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  auto q = std::atomic_load(&pub->async_queue);
+  if (q == nullptr) {
+    RMW_SET_ERROR_MSG("publisher is not asynchronous");
+    return RMW_RET_ERROR;
+  }
+  const AsyncPublishQueue::Stats s = q->stats();
+  stats->published = s.published;
+  stats->dropped = s.dropped;
+  stats->failed = s.failed;
+  stats->high_water_mark = s.high_water_mark;
+  stats->queue_depth = s.depth;
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_publish_many(
+  const rmw_publisher_t * publisher, const void * const * ros_messages,
+  size_t count, size_t * published)
+{
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(ros_messages);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  assert(pub);
+  bool all_local, all_shm, all_flat;
+  check_matched_subscriptions(pub, &all_local, &all_shm, &all_flat);
+  /* hold back the packets until all messages have been written */
+  {
+    std::lock_guard<std::mutex> lock(gcdds.batch_lock);
+    write_batching_ref();
+  }
+  const write_batching_state write_batching = get_write_batching_state();
+  rmw_ret_t ret = RMW_RET_OK;
+  size_t i;
+  for (i = 0; i < count; i++) {
+    if (ros_messages[i] == nullptr) {
+      RMW_SET_ERROR_MSG("ros_messages contains a null pointer");
+      ret = RMW_RET_INVALID_ARGUMENT;
+      break;
+    }
+    if ((ret = publish_sample(pub, ros_messages[i], all_local, all_shm, all_flat)) != RMW_RET_OK) {
+      break;
+    }
+  }
+  after_write(pub, write_batching);
+  {
+    std::lock_guard<std::mutex> lock(gcdds.batch_lock);
+    write_batching_unref();
+  }
+  if (published) {
+    *published = i;
+  }
+  return ret;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_set_publisher_batching(
+  const rmw_publisher_t * publisher, bool enable,
+  rmw_time_t max_delay)
+{
+  RET_WRONG_IMPLID(publisher);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  dds_duration_t delay = DDS_INFINITY;
+  if (max_delay.sec > 0 || max_delay.nsec > 0) {
+    delay = DDS_SECS(max_delay.sec) + max_delay.nsec;
+  }
+  set_batching(pub, enable, delay);
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_flush_publisher(const rmw_publisher_t * publisher)
+{
+  RET_WRONG_IMPLID(publisher);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  {
+    std::lock_guard<std::mutex> lock(gcdds.batch_lock);
+    pub->batch_pending_since = 0;
+  }
+  if (dds_write_flush(pub->enth) < 0) {
+    RMW_SET_ERROR_MSG("failed to flush writer");
+    return RMW_RET_ERROR;
+  }
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_publish_serialized_message(
+  const rmw_publisher_t * publisher,
+  const rmw_serialized_message_t * serialized_message, rmw_publisher_allocation_t * allocation)
+{
+  static_cast<void>(allocation);    // unused
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(serialized_message);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  struct ddsi_serdata * d = serdata_rmw_from_serialized_message(
+    pub->sertopic, serialized_message->buffer, serialized_message->buffer_length);
+  return write_serdata(pub, d);
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_publish_serialized_message_adopt(
+  const rmw_publisher_t * publisher,
+  rmw_serialized_message_t * serialized_message)
+{
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(serialized_message);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  const size_t size = serialized_message->buffer_length;
+  const size_t capacity = std::max(
+    serialized_message->buffer_capacity,
+    SerializedBufferPool::capacity_of(serialized_message->allocator, serialized_message->buffer));
+  struct ddsi_serdata * d = nullptr;
+  if (capacity < size + (0 - size) % 4) {
+    /* DDSI may read up to the next multiple of 4 bytes, no choice but to copy */
+    d = serdata_rmw_from_serialized_message(pub->sertopic, serialized_message->buffer, size);
+    if (rmw_serialized_message_fini(serialized_message) != RMW_RET_OK) {
+      RCUTILS_LOG_ERROR_NAMED("rmw_cyclonedds_cpp", "failed to free serialized message");
+    }
+  } else {
+    /* the deleter runs if allocating the control block fails, so the buffer is never leaked */
+    const rcutils_allocator_t allocator = serialized_message->allocator;
+    try {
+      std::shared_ptr<byte> payload(
+        reinterpret_cast<byte *>(serialized_message->buffer), [allocator](byte * buf) {
+          allocator.deallocate(buf, allocator.state);
+        });
+      d = serdata_rmw_from_shared_payload(pub->sertopic, std::move(payload), size);
+    } catch (std::bad_alloc &) {
+      RMW_SET_ERROR_MSG("failed to allocate serdata");
+    }
+  }
+  serialized_message->buffer = nullptr;
+  serialized_message->buffer_length = 0;
+  serialized_message->buffer_capacity = 0;
+  if (d == nullptr) {
+    return RMW_RET_ERROR;
+  }
+  return write_serdata(pub, d);
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_publish_iovec(
+  const rmw_publisher_t * publisher,
+  const rmw_cyclonedds_iovec_t * iov, size_t iovcnt)
+{
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(iov);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  size_t size = 0;
+  for (size_t i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_base == nullptr && iov[i].iov_len > 0) {
+      RMW_SET_ERROR_MSG("iovec segment without data");
+      return RMW_RET_INVALID_ARGUMENT;
+    }
+    size += iov[i].iov_len;
+  }
+  if (size < 4) {
+    RMW_SET_ERROR_MSG("serialized message too short for the encapsulation header");
+    return RMW_RET_INVALID_ARGUMENT;
+  }
+  /* the segments are gathered straight into a pooled payload, the only copy made of them */
+  struct ddsi_serdata * d;
+  try {
+    auto payload = serdata_rmw_allocate_payload(
+      size + (0 - size) % 4, pub->serialized_buffers->get_allocator());
+    size_t off = 0;
+    for (size_t i = 0; i < iovcnt; i++) {
+      if (iov[i].iov_len > 0) {
+        memcpy(byte_offset(payload.get(), off), iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+      }
+    }
+    d = serdata_rmw_from_shared_payload(pub->sertopic, std::move(payload), size);
+  } catch (std::bad_alloc &) {
+    RMW_SET_ERROR_MSG("failed to allocate serdata");
+    return RMW_RET_BAD_ALLOC;
+  }
+  return write_serdata(pub, d);
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_init_pooled_serialized_message(
+  const rmw_publisher_t * publisher,
+  size_t capacity,
+  rmw_serialized_message_t * serialized_message)
+{
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(serialized_message);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  rcutils_allocator_t allocator = pub->serialized_buffers->get_allocator();
+  return rmw_serialized_message_init(serialized_message, capacity, &allocator);
+}
+
+extern "C" rmw_ret_t rmw_publish_loaned_message(
+  const rmw_publisher_t * publisher,
+  void * ros_message,
+  rmw_publisher_allocation_t * allocation)
+{
+  static_cast<void>(allocation);    // unused
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(ros_message);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  std::shared_ptr<byte> payload;
+  {
+    std::lock_guard<std::mutex> lock(pub->loans_lock);
+    auto it = pub->loans.find(ros_message);
+    if (it == pub->loans.end()) {
+      RMW_SET_ERROR_MSG("message not loaned by this publisher");
+      return RMW_RET_ERROR;
+    }
+    payload = std::move(it->second);
+    pub->loans.erase(it);
+  }
+  if (!pub->loans_in_payload) {
+    /* payload holds the message and returns it to the pool once published */
+    return rmw_publish(publisher, ros_message, nullptr);
+  }
+  /* the message was constructed in place in the serialized payload, so there is nothing left
+     to do but hand it to DDSI */
+  auto st = static_cast<const struct sertopic_rmw *>(pub->sertopic);
+  const size_t size = 4 + st->cdr_writer->value_type()->sizeof_struct();
+  struct ddsi_serdata * d =
+    serdata_rmw_from_shared_payload(pub->sertopic, std::move(payload), size);
+  return write_serdata(pub, d);
+}
+
+static const rosidl_message_type_support_t * get_typesupport(
+  const rosidl_message_type_support_t * type_supports)
+{
+  const rosidl_message_type_support_t * ts;
+  if ((ts =
+    get_message_typesupport_handle(
+      type_supports, rosidl_typesupport_introspection_c__identifier)) != nullptr)
+  {
+    return ts;
+  } else {
+    if ((ts =
+      get_message_typesupport_handle(
+        type_supports, rosidl_typesupport_introspection_cpp::typesupport_identifier)) != nullptr)
+    {
+      return ts;
+    } else {
+      RMW_SET_ERROR_MSG("type support not from this implementation");
+      return nullptr;
+    }
+  }
+}
+
+static std::string make_fqtopic(
+  const char * prefix, const char * topic_name, const char * suffix,
+  bool avoid_ros_namespace_conventions)
+{
+  if (avoid_ros_namespace_conventions) {
+    return std::string(topic_name) + "__" + std::string(suffix);
+  } else {
+    return std::string(prefix) + std::string(topic_name) + std::string(suffix);
+  }
+}
+
+static std::string make_fqtopic(
+  const char * prefix, const char * topic_name, const char * suffix,
+  const rmw_qos_profile_t * qos_policies)
+{
+  return make_fqtopic(prefix, topic_name, suffix, qos_policies->avoid_ros_namespace_conventions);
+}
+
+static dds_qos_t * create_readwrite_qos(
+  const rmw_qos_profile_t * qos_policies,
+  bool ignore_local_publications)
+{
+  dds_duration_t ldur;
+  dds_qos_t * qos = dds_create_qos();
+  dds_qset_writer_data_lifecycle(qos, false); /* disable autodispose */
+  switch (qos_policies->history) {
+    case RMW_QOS_POLICY_HISTORY_SYSTEM_DEFAULT:
+    case RMW_QOS_POLICY_HISTORY_UNKNOWN:
+    case RMW_QOS_POLICY_HISTORY_KEEP_LAST:
+      if (qos_policies->depth == RMW_QOS_POLICY_DEPTH_SYSTEM_DEFAULT) {
+        dds_qset_history(qos, DDS_HISTORY_KEEP_LAST, 1);
+      } else {
+        if (qos_policies->depth < 1 || qos_policies->depth > INT32_MAX) {
+          RMW_SET_ERROR_MSG("unsupported history depth");
+          dds_delete_qos(qos);
+          return nullptr;
+        }
+        dds_qset_history(qos, DDS_HISTORY_KEEP_LAST, static_cast<int32_t>(qos_policies->depth));
+      }
+      break;
+    case RMW_QOS_POLICY_HISTORY_KEEP_ALL:
+      dds_qset_history(qos, DDS_HISTORY_KEEP_ALL, DDS_LENGTH_UNLIMITED);
+      break;
+    default:
+      rmw_cyclonedds_cpp::unreachable();
+  }
+  switch (qos_policies->reliability) {
+    case RMW_QOS_POLICY_RELIABILITY_SYSTEM_DEFAULT:
+    case RMW_QOS_POLICY_RELIABILITY_UNKNOWN:
+    case RMW_QOS_POLICY_RELIABILITY_RELIABLE:
+      dds_qset_reliability(qos, DDS_RELIABILITY_RELIABLE, DDS_INFINITY);
+      break;
+    case RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT:
+      dds_qset_reliability(qos, DDS_RELIABILITY_BEST_EFFORT, 0);
+      break;
+    default:
+      rmw_cyclonedds_cpp::unreachable();
+  }
+  switch (qos_policies->durability) {
+    case RMW_QOS_POLICY_DURABILITY_SYSTEM_DEFAULT:
+    case RMW_QOS_POLICY_DURABILITY_UNKNOWN:
+    case RMW_QOS_POLICY_DURABILITY_VOLATILE:
+      dds_qset_durability(qos, DDS_DURABILITY_VOLATILE);
+      break;
+    case RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL: {
+        /* Cyclone uses durability service QoS for determining what to retain as historical data,
+           separating the reliability window from the historical data; but that is somewhat unusual
+           among DDS implementations ... */
+        dds_history_kind_t hk;
+        int32_t hd;
+        dds_qget_history(qos, &hk, &hd);
+        dds_qset_durability(qos, DDS_DURABILITY_TRANSIENT_LOCAL);
+        dds_qset_durability_service(
+          qos, DDS_SECS(0), hk, hd, DDS_LENGTH_UNLIMITED, DDS_LENGTH_UNLIMITED,
+          DDS_LENGTH_UNLIMITED);
+        break;
+      }
+    default:
+      rmw_cyclonedds_cpp::unreachable();
+  }
+  if (qos_policies->lifespan.sec > 0 || qos_policies->lifespan.nsec > 0) {
+    dds_qset_lifespan(qos, DDS_SECS(qos_policies->lifespan.sec) + qos_policies->lifespan.nsec);
+  }
+  if (qos_policies->deadline.sec > 0 || qos_policies->deadline.nsec > 0) {
+    dds_qset_deadline(qos, DDS_SECS(qos_policies->deadline.sec) + qos_policies->deadline.nsec);
+  }
+
+  if (qos_policies->liveliness_lease_duration.sec == 0 &&
+    qos_policies->liveliness_lease_duration.nsec == 0)
+  {
+    ldur = DDS_INFINITY;
+  } else {
+    ldur = DDS_SECS(qos_policies->liveliness_lease_duration.sec) +
+      qos_policies->liveliness_lease_duration.nsec;
+  }
+  switch (qos_policies->liveliness) {
+    case RMW_QOS_POLICY_LIVELINESS_SYSTEM_DEFAULT:
+    case RMW_QOS_POLICY_LIVELINESS_AUTOMATIC:
+    case RMW_QOS_POLICY_LIVELINESS_UNKNOWN:
+      dds_qset_liveliness(qos, DDS_LIVELINESS_AUTOMATIC, ldur);
+      break;
+    case RMW_QOS_POLICY_LIVELINESS_MANUAL_BY_NODE:
+      dds_qset_liveliness(qos, DDS_LIVELINESS_MANUAL_BY_PARTICIPANT, ldur);
+      break;
+    case RMW_QOS_POLICY_LIVELINESS_MANUAL_BY_TOPIC:
+      dds_qset_liveliness(qos, DDS_LIVELINESS_MANUAL_BY_TOPIC, ldur);
+      break;
+  }
+  if (ignore_local_publications) {
+    dds_qset_ignorelocal(qos, DDS_IGNORELOCAL_PARTICIPANT);
+  }
+  return qos;
 }
 
 static rmw_qos_policy_kind_t dds_qos_policy_to_rmw_qos_policy(dds_qos_policy_id_t policy_id)
@@ -1648,7 +2676,8 @@ static CddsPublisher * create_cdds_publisher(
   dds_entity_t dds_ppant, dds_entity_t dds_pub,
   const rosidl_message_type_support_t * type_supports,
   const char * topic_name,
-  const rmw_qos_profile_t * qos_policies)
+  const rmw_qos_profile_t * qos_policies,
+  const rmw_cyclonedds_publisher_options_t * options)
 {
   RET_NULL_OR_EMPTYSTR_X(topic_name, return nullptr);
   RET_NULL_X(qos_policies, return nullptr);
@@ -1673,6 +2702,31 @@ static CddsPublisher * create_cdds_publisher(
   if ((qos = create_readwrite_qos(qos_policies, false)) == nullptr) {
     goto fail_qos;
   }
+  if (options != nullptr) {
+    /* the rate limit applies to all publishers, the maximum blocking time in the QoS only
+       matters for reliable writers, and it is fixed once the writer exists */
+    switch (options->when_history_full) {
+      case RMW_CYCLONEDDS_PUBLISH_BLOCK:
+        break;
+      case RMW_CYCLONEDDS_PUBLISH_BLOCK_BOUNDED:
+        pub->max_blocking =
+          DDS_SECS(options->max_blocking_time.sec) + options->max_blocking_time.nsec;
+        break;
+      case RMW_CYCLONEDDS_PUBLISH_DROP:
+        pub->max_blocking = 0;
+        pub->drop_when_full = true;
+        break;
+      default:
+        RMW_SET_ERROR_MSG("invalid when_history_full option");
+        goto fail_writer;
+    }
+    dds_reliability_kind_t kind;
+    if (pub->max_blocking != DDS_INFINITY &&
+      dds_qget_reliability(qos, &kind, nullptr) && kind == DDS_RELIABILITY_RELIABLE)
+    {
+      dds_qset_reliability(qos, DDS_RELIABILITY_RELIABLE, pub->max_blocking);
+    }
+  }
   if ((pub->enth = dds_create_writer(dds_pub, topic, qos, nullptr)) < 0) {
     RMW_SET_ERROR_MSG("failed to create writer");
     goto fail_writer;
@@ -1681,8 +2735,31 @@ static CddsPublisher * create_cdds_publisher(
     RMW_SET_ERROR_MSG("failed to get instance handle for writer");
     goto fail_instance_handle;
   }
+  if (dds_get_guid(dds_ppant, &pub->ppant_guid) < 0) {
+    RMW_SET_ERROR_MSG("failed to get participant GUID");
+    goto fail_instance_handle;
+  }
   get_entity_gid(pub->enth, pub->gid);
   pub->sertopic = stact;
+  pub->shm_allowed = shm_enabled() &&
+    qos_policies->durability != RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL;
+  /* durable data stays in the writer history for late-joining subscriptions, which need not
+     have the same layout, so it must be in CDR */
+  if (qos_policies->durability != RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL) {
+    pub->flat_layout = flat_layout_of(pub->sertopic);
+  }
+  if (qos_policies->reliability == RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT &&
+    qos_policies->durability != RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL)
+  {
+    pub->streaming_threshold = STREAMING_SERIALIZATION_THRESHOLD;
+  }
+  pub->serialized_buffers = SerializedBufferPool::create(SERIALIZED_BUFFER_POOL_SIZE);
+  {
+    auto st = static_cast<const struct sertopic_rmw *>(pub->sertopic);
+    pub->loans_in_payload = st->cdr_writer->is_plain();
+    pub->loan_pool = std::make_unique<rmw_cyclonedds_cpp::MessagePool>(
+      st->copier.get(), LOANED_MESSAGE_POOL_SIZE);
+  }
   dds_delete_qos(qos);
   dds_delete(topic);
   return pub;
@@ -1730,8 +2807,9 @@ static rmw_publisher_t * create_publisher(
   rmw_publisher_t * rmw_publisher;
   if ((pub =
     create_cdds_publisher(
-      dds_ppant, dds_pub, type_supports, topic_name,
-      qos_policies)) == nullptr)
+      dds_ppant, dds_pub, type_supports, topic_name, qos_policies,
+      static_cast<const rmw_cyclonedds_publisher_options_t *>(
+        publisher_options->rmw_specific_publisher_payload))) == nullptr)
   {
     goto fail_common_init;
   }
@@ -1743,7 +2821,7 @@ static rmw_publisher_t * create_publisher(
   RET_ALLOC_X(rmw_publisher->topic_name, goto fail_topic_name);
   memcpy(const_cast<char *>(rmw_publisher->topic_name), topic_name, strlen(topic_name) + 1);
   rmw_publisher->options = *publisher_options;
-  rmw_publisher->can_loan_messages = false;
+  rmw_publisher->can_loan_messages = can_loan_messages(pub->sertopic);
   return rmw_publisher;
 fail_topic_name:
   rmw_publisher_free(rmw_publisher);
@@ -1856,22 +2934,57 @@ extern "C" rmw_ret_t rmw_borrow_loaned_message(
   const rosidl_message_type_support_t * type_support,
   void ** ros_message)
 {
-  (void) publisher;
-  (void) type_support;
-  (void) ros_message;
-  RMW_SET_ERROR_MSG("rmw_borrow_loaned_message not implemented for rmw_cyclonedds_cpp");
-  return RMW_RET_UNSUPPORTED;
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(type_support);
+  RET_NULL(ros_message);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  auto st = static_cast<const struct sertopic_rmw *>(pub->sertopic);
+  auto value_type = st->cdr_writer->value_type();
+  try {
+    std::shared_ptr<byte> payload;
+    void * msg;
+    if (pub->loans_in_payload) {
+      /* plain types are lent out in the payload of a future serdata: that way publishing
+         doesn't require serialization nor copying */
+      const size_t size = 4 + value_type->sizeof_struct();
+      payload = serdata_rmw_allocate_payload(
+        size + (0 - size) % 4, pub->serialized_buffers->get_allocator());
+      st->cdr_writer->serialize_header(payload.get());
+      msg = byte_offset(payload.get(), 4);
+      value_type->init_message(msg);
+    } else {
+      /* others get a recycled message reset to the default state, which at least saves
+         constructing and destructing */
+      rmw_cyclonedds_cpp::MessagePool * pool = pub->loan_pool.get();
+      msg = pool->get_default();
+      payload = std::shared_ptr<byte>(
+        static_cast<byte *>(msg), [pool](byte * ptr) {
+          pool->put(ptr);
+        });
+    }
+    std::lock_guard<std::mutex> lock(pub->loans_lock);
+    pub->loans.emplace(msg, std::move(payload));
+    *ros_message = msg;
+    return RMW_RET_OK;
+  } catch (std::exception & e) {
+    RMW_SET_ERROR_MSG(e.what());
+    return RMW_RET_ERROR;
+  }
 }
 
 extern "C" rmw_ret_t rmw_return_loaned_message_from_publisher(
   const rmw_publisher_t * publisher,
   void * loaned_message)
 {
-  (void) publisher;
-  (void) loaned_message;
-  RMW_SET_ERROR_MSG(
-    "rmw_return_loaned_message_from_publisher not implemented for rmw_cyclonedds_cpp");
-  return RMW_RET_UNSUPPORTED;
+  RET_WRONG_IMPLID(publisher);
+  RET_NULL(loaned_message);
+  auto pub = static_cast<CddsPublisher *>(publisher->data);
+  std::lock_guard<std::mutex> lock(pub->loans_lock);
+  if (pub->loans.erase(loaned_message) == 0) {
+    RMW_SET_ERROR_MSG("message not loaned by this publisher");
+    return RMW_RET_ERROR;
+  }
+  return RMW_RET_OK;
 }
 
 static rmw_ret_t destroy_publisher(rmw_publisher_t * publisher)
@@ -1879,6 +2992,16 @@ static rmw_ret_t destroy_publisher(rmw_publisher_t * publisher)
   RET_WRONG_IMPLID(publisher);
   auto pub = static_cast<CddsPublisher *>(publisher->data);
   if (pub != nullptr) {
+    /* stops the worker after it has published the messages still queued */
+    std::atomic_store(&pub->async_queue, std::shared_ptr<AsyncPublishQueue>());
+    pub->has_async_queue.store(false);
+    if (pub->batching.load()) {
+      set_batching(pub, false, DDS_INFINITY);
+    }
+    /* the writer may hold the last reference to the sertopic, and with it the copier the loan
+       pool uses, so the loans and the pool must go first */
+    pub->loans.clear();
+    pub->loan_pool.reset();
     if (dds_delete(pub->enth) < 0) {
       RMW_SET_ERROR_MSG("failed to delete writer");
     }
@@ -1935,14 +3058,40 @@ static CddsSubscription * create_cdds_subscription(
     fqtopic_name.c_str(), type_support->typesupport_identifier,
     create_message_type_support(type_support->data, type_support->typesupport_identifier), false,
     rmw_cyclonedds_cpp::make_message_value_type(type_supports));
-  topic = create_topic(dds_ppant, sertopic);
+  struct ddsi_sertopic * stact;
+  topic = create_topic(dds_ppant, sertopic, &stact);
   if (topic < 0) {
     RMW_SET_ERROR_MSG("failed to create topic");
     goto fail_topic;
   }
+  sub->sertopic = stact;
+  sub->loan_pool = std::make_unique<rmw_cyclonedds_cpp::MessagePool>(
+    static_cast<const struct sertopic_rmw *>(stact)->copier.get(), LOANED_MESSAGE_POOL_SIZE);
+  if (qos_policies->history != RMW_QOS_POLICY_HISTORY_KEEP_ALL) {
+    /* the system default depth is 1 */
+    sub->prefetch_max = static_cast<uint32_t>(
+      std::max<size_t>(1, std::min<size_t>(qos_policies->depth, TAKE_PREFETCH_COUNT)));
+    sub->latest_only_refills = static_cast<uint32_t>(
+      (std::max<size_t>(1, qos_policies->depth) + sub->prefetch_max - 1) / sub->prefetch_max);
+  }
   if ((qos = create_readwrite_qos(qos_policies, ignore_local_publications)) == nullptr) {
     goto fail_qos;
   }
+  {
+    /* tell publishers on the same host they may send descriptors of samples in shared memory,
+       and those with the same layout of the type that they may send it in native form */
+    std::string ud;
+    if (shm_enabled() && shm_history_fits(qos_policies)) {
+      ud += "shm=" + shm_host_id() + ";";
+    }
+    const std::string flat_layout = flat_layout_of(sub->sertopic);
+    if (!flat_layout.empty()) {
+      ud += "flat=" + flat_layout + ";";
+    }
+    if (!ud.empty()) {
+      dds_qset_userdata(qos, ud.c_str(), ud.size());
+    }
+  }
   if ((sub->enth = dds_create_reader(dds_sub, topic, qos, nullptr)) < 0) {
     RMW_SET_ERROR_MSG("failed to create reader");
     goto fail_reader;
@@ -1972,18 +3121,25 @@ extern "C" rmw_ret_t rmw_init_subscription_allocation(
   const rosidl_message_type_support_t * type_support,
   const rosidl_message_bounds_t * message_bounds, rmw_subscription_allocation_t * allocation)
 {
-  static_cast<void>(type_support);
+  /* Deserializing reuses the storage of the strings and sequences already in the message taken
+     into, so a subscriber that keeps taking into the same message stops allocating once it has
+     seen the largest samples, and can size them up front (from the bounds, or the samples it
+     expects) simply by taking into a message prepared that way.  That storage must belong to
+     the message because the generated finalization functions free it, so there is nothing for
+     the allocation itself to hold. */
+  RET_NULL(type_support);
+  RET_NULL(allocation);
   static_cast<void>(message_bounds);
-  static_cast<void>(allocation);
-  RMW_SET_ERROR_MSG("rmw_init_subscription_allocation: unimplemented");
-  return RMW_RET_ERROR;
+  allocation->implementation_identifier = eclipse_cyclonedds_identifier;
+  allocation->data = nullptr;
+  return RMW_RET_OK;
 }
 
 extern "C" rmw_ret_t rmw_fini_subscription_allocation(rmw_subscription_allocation_t * allocation)
 {
-  static_cast<void>(allocation);
-  RMW_SET_ERROR_MSG("rmw_fini_subscription_allocation: unimplemented");
-  return RMW_RET_ERROR;
+  RET_WRONG_IMPLID(allocation);
+  allocation->implementation_identifier = nullptr;
+  return RMW_RET_OK;
 }
 
 static rmw_subscription_t * create_subscription(
@@ -2010,7 +3166,7 @@ static rmw_subscription_t * create_subscription(
   RET_ALLOC_X(rmw_subscription->topic_name, goto fail_topic_name);
   memcpy(const_cast<char *>(rmw_subscription->topic_name), topic_name, strlen(topic_name) + 1);
   rmw_subscription->options = *subscription_options;
-  rmw_subscription->can_loan_messages = false;
+  rmw_subscription->can_loan_messages = can_loan_messages(sub->sertopic);
   return rmw_subscription;
 fail_topic_name:
   rmw_subscription_free(rmw_subscription);
@@ -2067,62 +3223,399 @@ extern "C" rmw_ret_t rmw_subscription_count_matched_publishers(
   if (dds_get_subscription_matched_status(sub->enth, &status) < 0) {
     return RMW_RET_ERROR;
   } else {
-    *publisher_count = status.current_count;
-    return RMW_RET_OK;
+    *publisher_count = status.current_count;
+    return RMW_RET_OK;
+  }
+}
+
+extern "C" rmw_ret_t rmw_subscription_get_actual_qos(
+  const rmw_subscription_t * subscription,
+  rmw_qos_profile_t * qos)
+{
+  RET_NULL(qos);
+  RET_WRONG_IMPLID(subscription);
+  auto sub = static_cast<CddsSubscription *>(subscription->data);
+  if (get_readwrite_qos(sub->enth, qos)) {
+    return RMW_RET_OK;
+  } else {
+    return RMW_RET_ERROR;
+  }
+}
+
+static rmw_ret_t destroy_subscription(rmw_subscription_t * subscription)
+{
+  RET_WRONG_IMPLID(subscription);
+  auto sub = static_cast<CddsSubscription *>(subscription->data);
+  if (sub != nullptr) {
+    detach_from_waitsets(sub->waitset_refs, sub->rdcondh);
+    /* the reader may hold the last reference to the sertopic, which the serdatas and the
+       messages in the loan pool need for freeing them, so those must go first */
+    for (auto & loan : sub->loans) {
+      return_subscription_loan(sub, loan.first, loan.second);
+    }
+    sub->loans.clear();
+    drop_prefetched(sub);
+    sub->loan_pool.reset();
+    if (dds_delete(sub->rdcondh) < 0) {
+      RMW_SET_ERROR_MSG("failed to delete readcondition");
+    }
+    if (dds_delete(sub->enth) < 0) {
+      RMW_SET_ERROR_MSG("failed to delete reader");
+    }
+    delete sub;
+  }
+  rmw_free(const_cast<char *>(subscription->topic_name));
+  subscription->topic_name = nullptr;
+  rmw_subscription_free(subscription);
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_destroy_subscription(rmw_node_t * node, rmw_subscription_t * subscription)
+{
+  RET_WRONG_IMPLID(node);
+  {
+    auto common = &node->context->impl->common;
+    const auto cddssub = static_cast<const CddsSubscription *>(subscription->data);
+    std::lock_guard<std::mutex> guard(common->node_update_mutex);
+    rmw_dds_common::msg::ParticipantEntitiesInfo msg =
+      common->graph_cache.dissociate_writer(
+      cddssub->gid, common->gid, node->name,
+      node->namespace_);
+    if (RMW_RET_OK != rmw_publish(common->pub, static_cast<void *>(&msg), nullptr)) {
+      RMW_SET_ERROR_MSG(
+        "failed to publish ParticipantEntitiesInfo message after dissociating reader");
+    }
+  }
+  return destroy_subscription(subscription);
+}
+
+/* Converts a serdata in the native flat representation to one in CDR, consuming the reference
+   to the original and returning null if that fails */
+static serdata_rmw * flat_to_cdr(CddsSubscription * sub, serdata_rmw * d)
+{
+  struct ddsi_serdata * cdr = nullptr;
+  void * msg;
+  try {
+    msg = sub->loan_pool->get();
+  } catch (std::exception & e) {
+    ddsi_serdata_unref(d);
+    RMW_SET_ERROR_MSG(e.what());
+    return nullptr;
+  }
+  if (ddsi_serdata_to_sample(d, msg, nullptr, nullptr)) {
+    cdr = ddsi_serdata_from_sample(sub->sertopic, SDK_DATA, msg);
+  }
+  sub->loan_pool->put(msg);
+  ddsi_serdata_unref(d);
+  return static_cast<serdata_rmw *>(cdr);
+}
+
+/* Takes the next sample from the reader, taking up to prefetch_max of them at once and
+   keeping the others for subsequent calls, so that a burst of samples costs a single trip
+   through the reader */
+static bool take_prefetched(
+  CddsSubscription * sub, struct ddsi_serdata ** d,
+  dds_sample_info_t * info, uint32_t * refills)
+{
+  std::lock_guard<std::mutex> guard(sub->prefetch_lock);
+  if (sub->prefetch_next == sub->prefetch_count) {
+    if (refills != nullptr && *refills == 0) {
+      return false;
+    }
+    const dds_return_t n = dds_takecdr(
+      sub->enth, sub->prefetch_serdata, sub->prefetch_max, sub->prefetch_infos, DDS_ANY_STATE);
+    sub->prefetch_next = 0;
+    sub->prefetch_count = (n > 0) ? static_cast<uint32_t>(n) : 0;
+    if (refills != nullptr) {
+      /* a batch that isn't full emptied the reader, what arrives later is for the next take */
+      *refills = (sub->prefetch_count < sub->prefetch_max) ? 0 : *refills - 1;
+    }
+    if (n <= 0) {
+      return false;
+    }
+  }
+  *d = sub->prefetch_serdata[sub->prefetch_next];
+  *info = sub->prefetch_infos[sub->prefetch_next];
+  sub->prefetch_next++;
+  sub->prefetched.store(sub->prefetch_next < sub->prefetch_count);
+  return true;
+}
+
+static void drop_prefetched(CddsSubscription * sub)
+{
+  std::lock_guard<std::mutex> guard(sub->prefetch_lock);
+  while (sub->prefetch_next < sub->prefetch_count) {
+    ddsi_serdata_unref(sub->prefetch_serdata[sub->prefetch_next++]);
+  }
+  sub->prefetched.store(false);
+}
+
+/* Whether a sample is to be dropped by the decimation settings of the subscription */
+static bool decimate_sample(CddsSubscription * sub, const dds_sample_info_t & info)
+{
+  if (!sub->decimating.load()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(sub->decimate_lock);
+  bool drop = false;
+  if (sub->decimate_n > 1) {
+    drop = (sub->decimate_skipped + 1 < sub->decimate_n);
+  }
+  if (!drop && sub->decimate_period > 0 && sub->decimate_have_last) {
+    drop = (info.source_timestamp - sub->decimate_last < sub->decimate_period);
+  }
+  if (drop) {
+    sub->decimate_skipped++;
+    sub->decimated++;
+  } else {
+    sub->decimate_skipped = 0;
+    sub->decimate_have_last = true;
+    sub->decimate_last = info.source_timestamp;
+  }
+  return drop;
+}
+
+/* Replaces *dcmn by a serdata with the serialized sample in its payload, for inspecting it
+   before deserializing it: a sample in shared memory is copied out of it, and if need_cdr is
+   set, one in the native flat representation is converted to CDR.  Returns false, with *dcmn
+   null, if that fails or the sample has been overwritten.  That costs the zero-copy path, but
+   the sample would be copied out for deserializing anyway. */
+static bool resolve_payload(CddsSubscription * sub, struct ddsi_serdata ** dcmn, bool need_cdr)
+{
+  auto d = static_cast<serdata_rmw *>(*dcmn);
+  /* both the content filter and the change-only hash need the serialized sample, so one from a
+     writer in this process has to be serialized; it is in CDR then, nothing else to check */
+  d->materialize();
+  if (d->native_sample() != nullptr) {
+    return true;
+  }
+  if (shm_is_descriptor(d->data(), d->size())) {
+    struct ddsi_serdata * copy = nullptr;
+    const bool intact = shm_with_sample(
+      d->data(), d->size(), [sub, &copy](const void * data, size_t size) {
+        try {
+          copy = serdata_rmw_from_serialized_message(sub->sertopic, data, size);
+        } catch (std::bad_alloc &) {
+        }
+        return copy != nullptr;
+      });
+    ddsi_serdata_unref(d);
+    if (!intact && copy != nullptr) {
+      ddsi_serdata_unref(copy);
+      copy = nullptr;
+    }
+    *dcmn = copy;
+    if ((d = static_cast<serdata_rmw *>(copy)) == nullptr) {
+      return false;
+    }
+  }
+  if (need_cdr && rmw_cyclonedds_cpp::is_flat_payload(d->data(), d->size())) {
+    *dcmn = d = flat_to_cdr(sub, d);
+    if (d == nullptr) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Whether a sample passes the content filter of the subscription, which works on CDR; *dcmn
+   gets replaced as in resolve_payload, a sample that can't be resolved is rejected */
+static bool content_filter_accepts(CddsSubscription * sub, struct ddsi_serdata ** dcmn)
+{
+  if (!sub->has_content_filter.load(std::memory_order_relaxed)) {
+    return true;
+  }
+  auto filter = std::atomic_load(&sub->content_filter);
+  if (!filter) {
+    return true;
+  }
+  if (!resolve_payload(sub, dcmn, true)) {
+    return false;
+  }
+  auto d = static_cast<serdata_rmw *>(*dcmn);
+  if (!filter->matches(d->data(), d->size())) {
+    sub->filtered++;
+    return false;
+  }
+  return true;
+}
+
+/* A 64-bit hash of a payload, for recognizing repeated samples.  It is a variant of xxHash64:
+   four independent lanes each consume 8 bytes of every 32, so the multiplications are free to
+   overlap, and the final mixing ensures that every input bit affects every output bit. */
+static uint64_t payload_hash(const void * data, size_t size)
+{
+  static const uint64_t prime1 = 11400714785074694791ull;
+  static const uint64_t prime2 = 14029467366897019727ull;
+  static const uint64_t prime3 = 1609587929392839161ull;
+  auto rotl = [](uint64_t x, int r) {return (x << r) | (x >> (64 - r));};
+  auto round = [rotl](uint64_t acc, uint64_t lane) {return rotl(acc + lane * prime2, 31) * prime1;};
+  auto p = static_cast<const unsigned char *>(data);
+  const unsigned char * const end = p + size;
+  uint64_t h;
+  if (size >= 32) {
+    uint64_t v[4] = {prime1 + prime2, prime2, 0, 0 - prime1};
+    do {
+      for (int i = 0; i < 4; i++) {
+        uint64_t lane;
+        memcpy(&lane, p + 8 * i, sizeof(lane));
+        v[i] = round(v[i], lane);
+      }
+      p += 32;
+    } while (end - p >= 32);
+    h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+    for (int i = 0; i < 4; i++) {
+      h = (h ^ round(0, v[i])) * prime1 + prime3;
+    }
+  } else {
+    h = prime3;
+  }
+  h += size;
+  for (; end - p >= 8; p += 8) {
+    uint64_t lane;
+    memcpy(&lane, p, sizeof(lane));
+    h = rotl(h ^ round(0, lane), 27) * prime1 + prime3;
   }
+  for (; p < end; p++) {
+    h = rotl(h ^ (*p * prime3), 11) * prime1;
+  }
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+  return h;
 }
 
-extern "C" rmw_ret_t rmw_subscription_get_actual_qos(
-  const rmw_subscription_t * subscription,
-  rmw_qos_profile_t * qos)
+/* Whether a sample is to be dropped because the subscription is in change-only mode and it is
+   identical to the previous one from the same writer; *dcmn gets replaced as in
+   resolve_payload, a sample that can't be resolved is dropped */
+static bool suppress_repeat(
+  CddsSubscription * sub, struct ddsi_serdata ** dcmn,
+  const dds_sample_info_t & info)
 {
-  RET_NULL(qos);
-  RET_WRONG_IMPLID(subscription);
-  auto sub = static_cast<CddsSubscription *>(subscription->data);
-  if (get_readwrite_qos(sub->enth, qos)) {
-    return RMW_RET_OK;
+  if (!sub->change_only.load()) {
+    return false;
+  }
+  if (!resolve_payload(sub, dcmn, false)) {
+    return true;
+  }
+  auto d = static_cast<serdata_rmw *>(*dcmn);
+  const std::pair<size_t, uint64_t> digest(d->size(), payload_hash(d->data(), d->size()));
+  std::lock_guard<std::mutex> guard(sub->change_only_lock);
+  auto it = sub->change_only_last.find(info.publication_handle);
+  if (it == sub->change_only_last.end()) {
+    if (sub->change_only_last.size() >= CHANGE_ONLY_MAX_WRITERS) {
+      sub->change_only_last.clear();
+    }
+    sub->change_only_last.emplace(info.publication_handle, digest);
+    return false;
+  } else if (it->second == digest) {
+    sub->suppressed++;
+    return true;
   } else {
-    return RMW_RET_ERROR;
+    it->second = digest;
+    return false;
   }
 }
 
-static rmw_ret_t destroy_subscription(rmw_subscription_t * subscription)
+/* Takes the next sample with valid data that passes the content filter, is not a repeat in
+   change-only mode and survives decimation, or if the subscription is in
+   latest-only mode, all such samples available and returns only the newest of them, dropping
+   the others undecoded */
+static bool take_next_valid(
+  CddsSubscription * sub, struct ddsi_serdata ** d,
+  dds_sample_info_t * info)
 {
-  RET_WRONG_IMPLID(subscription);
-  auto sub = static_cast<CddsSubscription *>(subscription->data);
-  if (sub != nullptr) {
-    clean_waitset_caches();
-    if (dds_delete(sub->rdcondh) < 0) {
-      RMW_SET_ERROR_MSG("failed to delete readcondition");
+  struct ddsi_serdata * dcmn;
+  dds_sample_info_t dinfo;
+  /* in latest-only mode, only the samples available when the take starts are considered, or a
+     publisher that is fast enough could keep it from ever returning */
+  const bool latest_only = sub->latest_only.load();
+  uint32_t refills = sub->latest_only_refills;
+  *d = nullptr;
+  while (take_prefetched(sub, &dcmn, &dinfo, latest_only ? &refills : nullptr)) {
+    if (!dinfo.valid_data || !content_filter_accepts(sub, &dcmn) ||
+      suppress_repeat(sub, &dcmn, dinfo) || decimate_sample(sub, dinfo))
+    {
+      if (dcmn != nullptr) {
+        ddsi_serdata_unref(dcmn);
+      }
+      continue;
     }
-    if (dds_delete(sub->enth) < 0) {
-      RMW_SET_ERROR_MSG("failed to delete reader");
+    if (*d != nullptr) {
+      ddsi_serdata_unref(*d);
+      sub->conflated++;
+    }
+    *d = dcmn;
+    *info = dinfo;
+    if (!latest_only) {
+      break;
     }
-    delete sub;
   }
-  rmw_free(const_cast<char *>(subscription->topic_name));
-  subscription->topic_name = nullptr;
-  rmw_subscription_free(subscription);
-  return RMW_RET_OK;
+  return *d != nullptr;
 }
 
-extern "C" rmw_ret_t rmw_destroy_subscription(rmw_node_t * node, rmw_subscription_t * subscription)
+/* Takes the next sample with valid data as a serdata, returning null if there is none; the
+   caller gets the reference and is responsible for releasing it.  If resolve_shm is set, a
+   sample in the shared memory of a publisher is copied out of it (samples overwritten before
+   that are skipped), otherwise the serdata may hold a descriptor, which deserializing it
+   handles.  If need_cdr is set, a sample in the native flat representation is converted to
+   CDR, and one from a writer in this process is serialized; otherwise the latter retains only
+   its copy of the sample and data() mustn't be used on it. */
+static serdata_rmw * take_next_serdata(
+  CddsSubscription * sub, dds_sample_info_t * info,
+  bool resolve_shm, bool need_cdr)
 {
-  RET_WRONG_IMPLID(node);
-  {
-    auto common = &node->context->impl->common;
-    const auto cddssub = static_cast<const CddsSubscription *>(subscription->data);
-    std::lock_guard<std::mutex> guard(common->node_update_mutex);
-    rmw_dds_common::msg::ParticipantEntitiesInfo msg =
-      common->graph_cache.dissociate_writer(
-      cddssub->gid, common->gid, node->name,
-      node->namespace_);
-    if (RMW_RET_OK != rmw_publish(common->pub, static_cast<void *>(&msg), nullptr)) {
-      RMW_SET_ERROR_MSG(
-        "failed to publish ParticipantEntitiesInfo message after dissociating reader");
+  struct ddsi_serdata * dcmn;
+  while (take_next_valid(sub, &dcmn, info)) {
+    auto d = static_cast<serdata_rmw *>(dcmn);
+    if (!need_cdr && d->native_sample() != nullptr) {
+      /* deserializing it is a copy of the sample, serializing it would be wasted effort */
+      return d;
+    }
+    /* a serdata from a writer in this process need not have been serialized yet */
+    d->materialize();
+    if (resolve_shm && shm_is_descriptor(d->data(), d->size())) {
+      struct ddsi_serdata * copy = nullptr;
+      const bool intact = shm_with_sample(
+        d->data(), d->size(), [sub, &copy](const void * data, size_t size) {
+          try {
+            copy = serdata_rmw_from_serialized_message(sub->sertopic, data, size);
+          } catch (std::bad_alloc &) {
+          }
+          return copy != nullptr;
+        });
+      ddsi_serdata_unref(dcmn);
+      if (!intact) {
+        if (copy != nullptr) {
+          ddsi_serdata_unref(copy);
+        }
+        continue;
+      }
+      d = static_cast<serdata_rmw *>(copy);
+    }
+    if (need_cdr && rmw_cyclonedds_cpp::is_flat_payload(d->data(), d->size())) {
+      if ((d = flat_to_cdr(sub, d)) == nullptr) {
+        continue;
+      }
     }
+    return d;
   }
-  return destroy_subscription(subscription);
+  return nullptr;
+}
+
+static void set_message_info(rmw_message_info_t * message_info, const dds_sample_info_t & info)
+{
+  message_info->publisher_gid.implementation_identifier = eclipse_cyclonedds_identifier;
+  memset(message_info->publisher_gid.data, 0, sizeof(message_info->publisher_gid.data));
+  assert(sizeof(info.publication_handle) <= sizeof(message_info->publisher_gid.data));
+  memcpy(
+    message_info->publisher_gid.data, &info.publication_handle,
+    sizeof(info.publication_handle));
+  message_info->source_timestamp = info.source_timestamp;
+  // TODO(iluetkeb) add received timestamp, when implemented by Cyclone
+  message_info->received_timestamp = 0;
 }
 
 static rmw_ret_t rmw_take_int(
@@ -2135,29 +3628,30 @@ static rmw_ret_t rmw_take_int(
   CddsSubscription * sub = static_cast<CddsSubscription *>(subscription->data);
   RET_NULL(sub);
   dds_sample_info_t info;
-  while (dds_take(sub->enth, &ros_message, &info, 1, 1) == 1) {
-    if (info.valid_data) {
-      *taken = true;
-      if (message_info) {
-        message_info->publisher_gid.implementation_identifier = eclipse_cyclonedds_identifier;
-        memset(message_info->publisher_gid.data, 0, sizeof(message_info->publisher_gid.data));
-        assert(sizeof(info.publication_handle) <= sizeof(message_info->publisher_gid.data));
-        memcpy(
-          message_info->publisher_gid.data, &info.publication_handle,
-          sizeof(info.publication_handle));
-        message_info->source_timestamp = info.source_timestamp;
-        // TODO(iluetkeb) add received timestamp, when implemented by Cyclone
-        message_info->received_timestamp = 0;
-      }
+  serdata_rmw * d;
+  while ((d = take_next_serdata(sub, &info, false, false)) != nullptr) {
+    const bool ok = ddsi_serdata_to_sample(d, ros_message, nullptr, nullptr);
+    /* a sample in shared memory may have been overwritten before it could be deserialized */
+    const bool lost = !ok && !d->is_streaming() && shm_is_descriptor(d->data(), d->size());
+    ddsi_serdata_unref(d);
+    if (lost) {
+      continue;
+    } else if (!ok) {
+      *taken = false;
+      return RMW_RET_ERROR;
+    }
+    *taken = true;
+    if (message_info) {
+      set_message_info(message_info, info);
+    }
 #if REPORT_LATE_MESSAGES > 0
-      dds_time_t tnow = dds_time();
-      dds_time_t dt = tnow - info.source_timestamp;
-      if (dt >= DDS_MSECS(REPORT_LATE_MESSAGES)) {
-        fprintf(stderr, "** sample in history for %.fms\n", static_cast<double>(dt) / 1e6);
-      }
-#endif
-      return RMW_RET_OK;
+    dds_time_t tnow = dds_time();
+    dds_time_t dt = tnow - info.source_timestamp;
+    if (dt >= DDS_MSECS(REPORT_LATE_MESSAGES)) {
+      fprintf(stderr, "** sample in history for %.fms\n", static_cast<double>(dt) / 1e6);
     }
+#endif
+    return RMW_RET_OK;
   }
   *taken = false;
   return RMW_RET_OK;
@@ -2188,49 +3682,27 @@ static rmw_ret_t rmw_take_seq(
   CddsSubscription * sub = static_cast<CddsSubscription *>(subscription->data);
   RET_NULL(sub);
 
-  std::vector<dds_sample_info_t> infos(count);
-  auto ret = dds_take(sub->enth, message_sequence->data, infos.data(), count, count);
-
-  // Returning 0 should not be an error, as it just indicates that no messages were available.
-  if (ret < 0) {
-    return RMW_RET_ERROR;
-  }
-
-  // Keep track of taken/not taken to reorder sequence with valid messages at the front
-  std::vector<void *> taken_msg;
-  std::vector<void *> not_taken_msg;
+  // Valid samples are deserialized into the messages at the front of the sequence as they are
+  // taken, so the messages never need reordering; samples are taken from the reader in batches
+  // by take_next_serdata, so this doesn't allocate
   *taken = 0u;
-
-  for (int ii = 0; ii < ret; ++ii) {
-    const dds_sample_info_t & info = infos[ii];
-
-    void * message = &message_sequence->data[ii];
-    rmw_message_info_t * message_info = &message_info_sequence->data[*taken];
-
-    if (info.valid_data) {
-      taken_msg.push_back(message);
+  dds_sample_info_t info;
+  serdata_rmw * d;
+  while (*taken < count && (d = take_next_serdata(sub, &info, false, false)) != nullptr) {
+    const bool ok = ddsi_serdata_to_sample(d, message_sequence->data[*taken], nullptr, nullptr);
+    /* a sample in shared memory may have been overwritten before it could be deserialized */
+    const bool lost = !ok && !d->is_streaming() && shm_is_descriptor(d->data(), d->size());
+    ddsi_serdata_unref(d);
+    if (ok) {
+      set_message_info(&message_info_sequence->data[*taken], info);
       (*taken)++;
-      if (message_info) {
-        message_info->publisher_gid.implementation_identifier = eclipse_cyclonedds_identifier;
-        memset(message_info->publisher_gid.data, 0, sizeof(message_info->publisher_gid.data));
-        assert(sizeof(info.publication_handle) <= sizeof(message_info->publisher_gid.data));
-        memcpy(
-          message_info->publisher_gid.data, &info.publication_handle,
-          sizeof(info.publication_handle));
-      }
-    } else {
-      not_taken_msg.push_back(message);
+    } else if (!lost) {
+      message_sequence->size = *taken;
+      message_info_sequence->size = *taken;
+      return RMW_RET_ERROR;
     }
   }
 
-  for (size_t ii = 0; ii < taken_msg.size(); ++ii) {
-    message_sequence->data[ii] = taken_msg[ii];
-  }
-
-  for (size_t ii = 0; ii < not_taken_msg.size(); ++ii) {
-    message_sequence->data[ii + taken_msg.size()] = not_taken_msg[ii];
-  }
-
   message_sequence->size = *taken;
   message_info_sequence->size = *taken;
 
@@ -2248,33 +3720,151 @@ static rmw_ret_t rmw_take_ser_int(
   CddsSubscription * sub = static_cast<CddsSubscription *>(subscription->data);
   RET_NULL(sub);
   dds_sample_info_t info;
-  struct ddsi_serdata * dcmn;
-  while (dds_takecdr(sub->enth, &dcmn, 1, &info, DDS_ANY_STATE) == 1) {
-    if (info.valid_data) {
-      if (message_info) {
-        message_info->publisher_gid.implementation_identifier = eclipse_cyclonedds_identifier;
-        memset(message_info->publisher_gid.data, 0, sizeof(message_info->publisher_gid.data));
-        assert(sizeof(info.publication_handle) <= sizeof(message_info->publisher_gid.data));
-        memcpy(
-          message_info->publisher_gid.data, &info.publication_handle,
-          sizeof(info.publication_handle));
-      }
-      auto d = static_cast<serdata_rmw *>(dcmn);
-      /* FIXME: what about the header - should be included or not? */
-      if (rmw_serialized_message_resize(serialized_message, d->size()) != RMW_RET_OK) {
-        ddsi_serdata_unref(dcmn);
-        *taken = false;
-        return RMW_RET_ERROR;
-      }
-      memcpy(serialized_message->buffer, d->data(), d->size());
-      serialized_message->buffer_length = d->size();
-      ddsi_serdata_unref(dcmn);
-      *taken = true;
-      return RMW_RET_OK;
+  serdata_rmw * d;
+  if ((d = take_next_serdata(sub, &info, true, true)) == nullptr) {
+    *taken = false;
+    return RMW_RET_OK;
+  }
+  if (message_info) {
+    set_message_info(message_info, info);
+  }
+  /* FIXME: what about the header - should be included or not? */
+  if (rmw_serialized_message_resize(serialized_message, d->size()) != RMW_RET_OK) {
+    ddsi_serdata_unref(d);
+    *taken = false;
+    return RMW_RET_ERROR;
+  }
+  memcpy(serialized_message->buffer, d->data(), d->size());
+  serialized_message->buffer_length = d->size();
+  ddsi_serdata_unref(d);
+  *taken = true;
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_set_subscription_latest_only(
+  const rmw_subscription_t * subscription, bool enable)
+{
+  RET_WRONG_IMPLID(subscription);
+  auto sub = static_cast<CddsSubscription *>(subscription->data);
+  sub->latest_only.store(enable);
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_get_subscription_take_stats(
+  const rmw_subscription_t * subscription,
+  rmw_cyclonedds_subscription_take_stats_t * stats)
+{
+  RET_WRONG_IMPLID(subscription);
+  RET_NULL(stats);
+  auto sub = static_cast<CddsSubscription *>(subscription->data);
+  stats->conflated = sub->conflated.load();
+  stats->decimated = sub->decimated.load();
+  stats->filtered = sub->filtered.load();
+  stats->suppressed = sub->suppressed.load();
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_set_subscription_decimation(
+  const rmw_subscription_t * subscription, rmw_time_t min_period,
+  uint32_t keep_every_n)
+{
+  RET_WRONG_IMPLID(subscription);
+  auto sub = static_cast<CddsSubscription *>(subscription->data);
+  std::lock_guard<std::mutex> guard(sub->decimate_lock);
+  sub->decimate_n = keep_every_n;
+  sub->decimate_period = DDS_SECS(min_period.sec) + min_period.nsec;
+  /* the first sample is delivered, as with a minimum period */
+  sub->decimate_skipped = (keep_every_n > 1) ? keep_every_n - 1 : 0;
+  sub->decimate_have_last = false;
+  sub->decimating.store(sub->decimate_n > 1 || sub->decimate_period > 0);
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_set_subscription_change_only(
+  const rmw_subscription_t * subscription, bool enable)
+{
+  RET_WRONG_IMPLID(subscription);
+  auto sub = static_cast<CddsSubscription *>(subscription->data);
+  std::lock_guard<std::mutex> guard(sub->change_only_lock);
+  sub->change_only_last.clear();
+  sub->change_only.store(enable);
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_set_subscription_content_filter(
+  const rmw_subscription_t * subscription, const char * expression,
+  size_t n_parameters, const char * const * parameters)
+{
+  RET_WRONG_IMPLID(subscription);
+  auto sub = static_cast<CddsSubscription *>(subscription->data);
+  if (expression == nullptr || *expression == 0) {
+    std::atomic_store(&sub->content_filter, decltype(sub->content_filter)());
+    sub->has_content_filter.store(false);
+    return RMW_RET_OK;
+  }
+  if (n_parameters > 0) {
+    RET_NULL(parameters);
+  }
+  auto st = static_cast<const struct sertopic_rmw *>(sub->sertopic);
+  try {
+    std::vector<std::string> params;
+    for (size_t i = 0; i < n_parameters; i++) {
+      RET_NULL(parameters[i]);
+      params.emplace_back(parameters[i]);
     }
-    ddsi_serdata_unref(dcmn);
+    std::shared_ptr<const rmw_cyclonedds_cpp::ContentFilter> filter =
+      rmw_cyclonedds_cpp::ContentFilter::compile(st->cdr_writer->value_type(), expression, params);
+    std::atomic_store(&sub->content_filter, filter);
+    sub->has_content_filter.store(true);
+  } catch (std::invalid_argument & e) {
+    RMW_SET_ERROR_MSG(e.what());
+    return RMW_RET_INVALID_ARGUMENT;
+  } catch (std::exception & e) {
+    RMW_SET_ERROR_MSG(e.what());
+    return RMW_RET_ERROR;
   }
-  *taken = false;
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_take_serialized_message_loan(
+  const rmw_subscription_t * subscription,
+  rmw_cyclonedds_serialized_message_loan_t * loan, bool * taken,
+  rmw_message_info_t * message_info)
+{
+  RET_NULL(taken);
+  RET_NULL(loan);
+  RET_WRONG_IMPLID(subscription);
+  CddsSubscription * sub = static_cast<CddsSubscription *>(subscription->data);
+  RET_NULL(sub);
+  dds_sample_info_t info;
+  serdata_rmw * d;
+  if ((d = take_next_serdata(sub, &info, true, true)) == nullptr) {
+    *taken = false;
+    return RMW_RET_OK;
+  }
+  if (message_info) {
+    set_message_info(message_info, info);
+  }
+  /* the payload of a materialized serdata never changes, so handing out a pointer to it is
+     fine as long as the reference is kept */
+  loan->buffer = static_cast<const uint8_t *>(d->data());
+  loan->buffer_length = d->size();
+  loan->impl = d;
+  *taken = true;
+  return RMW_RET_OK;
+}
+
+extern "C" rmw_ret_t rmw_cyclonedds_return_serialized_message_loan(
+  const rmw_subscription_t * subscription,
+  rmw_cyclonedds_serialized_message_loan_t * loan)
+{
+  RET_WRONG_IMPLID(subscription);
+  RET_NULL(loan);
+  RET_NULL(loan->impl);
+  ddsi_serdata_unref(static_cast<serdata_rmw *>(loan->impl));
+  loan->buffer = nullptr;
+  loan->buffer_length = 0;
+  loan->impl = nullptr;
   return RMW_RET_OK;
 }
 
@@ -2324,18 +3914,103 @@ extern "C" rmw_ret_t rmw_take_serialized_message_with_info(
   return rmw_take_ser_int(subscription, serialized_message, taken, message_info);
 }
 
+/* Pointer to the message in the payload of a serdata if it can be lent out in place: the type
+   must be plain and the payload in native byte order, long enough and suitably aligned, and the
+   caller must hold the only reference to the serdata.  The loan is writable, so a serdata that
+   is also in the history of another reader or in the writer history of a publisher in this
+   process must not be lent out. */
+static void * plain_message_in_payload(const struct sertopic_rmw * st, serdata_rmw * d)
+{
+  auto cdr_writer = st->cdr_writer.get();
+  if (!cdr_writer->is_plain() || d->native_sample() != nullptr ||
+    ddsrt_atomic_ld32(&d->refc) != 1 ||
+    d->size() < 4 + cdr_writer->value_type()->sizeof_struct())
+  {
+    return nullptr;
+  }
+  byte header[4];
+  cdr_writer->serialize_header(header);
+  /* the options in the last two bytes of the header don't matter */
+  if (memcmp(d->data(), header, 2) != 0) {
+    return nullptr;
+  }
+  void * msg = byte_offset(d->data(), 4);
+  if (reinterpret_cast<uintptr_t>(msg) % 8 != 0) {
+    return nullptr;
+  }
+  return msg;
+}
+
+static rmw_ret_t rmw_take_loan_int(
+  const rmw_subscription_t * subscription, void ** loaned_message,
+  bool * taken, rmw_message_info_t * message_info)
+{
+  RET_NULL(taken);
+  RET_NULL(loaned_message);
+  RET_WRONG_IMPLID(subscription);
+  CddsSubscription * sub = static_cast<CddsSubscription *>(subscription->data);
+  RET_NULL(sub);
+  auto st = static_cast<const struct sertopic_rmw *>(sub->sertopic);
+  dds_sample_info_t info;
+  serdata_rmw * d;
+  if ((d = take_next_serdata(sub, &info, true, false)) == nullptr) {
+    *taken = false;
+    return RMW_RET_OK;
+  }
+  void * msg;
+  struct ddsi_serdata * owner;
+  if ((msg = plain_message_in_payload(st, d)) != nullptr) {
+    /* the serdata reference is kept until the loan is returned */
+    owner = d;
+  } else {
+    /* not a plain type, other byte order, misaligned or shared: deserialize into a recycled
+       message, which retains the capacity of its strings and sequences */
+    try {
+      msg = sub->loan_pool->get();
+    } catch (std::exception & e) {
+      ddsi_serdata_unref(d);
+      RMW_SET_ERROR_MSG(e.what());
+      return RMW_RET_ERROR;
+    }
+    const bool ok = ddsi_serdata_to_sample(d, msg, nullptr, nullptr);
+    ddsi_serdata_unref(d);
+    if (!ok) {
+      sub->loan_pool->put(msg);
+      return RMW_RET_ERROR;
+    }
+    owner = nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> lock(sub->loans_lock);
+    sub->loans.emplace(msg, owner);
+  }
+  if (message_info) {
+    set_message_info(message_info, info);
+  }
+  *loaned_message = msg;
+  *taken = true;
+  return RMW_RET_OK;
+}
+
+static void return_subscription_loan(
+  CddsSubscription * sub, void * loaned_message,
+  struct ddsi_serdata * d)
+{
+  if (d != nullptr) {
+    ddsi_serdata_unref(d);
+  } else {
+    sub->loan_pool->put(loaned_message);
+  }
+}
+
 extern "C" rmw_ret_t rmw_take_loaned_message(
   const rmw_subscription_t * subscription,
   void ** loaned_message,
   bool * taken,
   rmw_subscription_allocation_t * allocation)
 {
-  (void) subscription;
-  (void) loaned_message;
-  (void) taken;
-  (void) allocation;
-  RMW_SET_ERROR_MSG("rmw_take_loaned_message not implemented for rmw_cyclonedds_cpp");
-  return RMW_RET_UNSUPPORTED;
+  static_cast<void>(allocation);
+  return rmw_take_loan_int(subscription, loaned_message, taken, nullptr);
 }
 
 extern "C" rmw_ret_t rmw_take_loaned_message_with_info(
@@ -2345,24 +4020,31 @@ extern "C" rmw_ret_t rmw_take_loaned_message_with_info(
   rmw_message_info_t * message_info,
   rmw_subscription_allocation_t * allocation)
 {
-  (void) subscription;
-  (void) loaned_message;
-  (void) taken;
-  (void) message_info;
-  (void) allocation;
-  RMW_SET_ERROR_MSG("rmw_take_loaned_message_with_info not implemented for rmw_cyclonedds_cpp");
-  return RMW_RET_UNSUPPORTED;
+  static_cast<void>(allocation);
+  RET_NULL(message_info);
+  return rmw_take_loan_int(subscription, loaned_message, taken, message_info);
 }
 
 extern "C" rmw_ret_t rmw_return_loaned_message_from_subscription(
   const rmw_subscription_t * subscription,
   void * loaned_message)
 {
-  (void) subscription;
-  (void) loaned_message;
-  RMW_SET_ERROR_MSG(
-    "rmw_return_loaned_message_from_subscription not implemented for rmw_cyclonedds_cpp");
-  return RMW_RET_UNSUPPORTED;
+  RET_WRONG_IMPLID(subscription);
+  RET_NULL(loaned_message);
+  CddsSubscription * sub = static_cast<CddsSubscription *>(subscription->data);
+  struct ddsi_serdata * d;
+  {
+    std::lock_guard<std::mutex> lock(sub->loans_lock);
+    auto it = sub->loans.find(loaned_message);
+    if (it == sub->loans.end()) {
+      RMW_SET_ERROR_MSG("message not loaned by this subscription");
+      return RMW_RET_ERROR;
+    }
+    d = it->second;
+    sub->loans.erase(it);
+  }
+  return_subscription_loan(sub, loaned_message, d);
+  return RMW_RET_OK;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -2578,7 +4260,7 @@ static rmw_ret_t destroy_guard_condition(rmw_guard_condition_t * guard_condition
 {
   RET_NULL(guard_condition_handle);
   auto * gcond_impl = static_cast<CddsGuardCondition *>(guard_condition_handle->data);
-  clean_waitset_caches();
+  detach_from_waitsets(gcond_impl->waitset_refs, gcond_impl->gcondh);
   dds_delete(gcond_impl->gcondh);
   delete gcond_impl;
   delete guard_condition_handle;
@@ -2617,7 +4299,7 @@ extern "C" rmw_wait_set_t * rmw_create_wait_set(rmw_context_t * context, size_t
     goto fail_ws;
   }
   ws->inuse = false;
-  ws->nelems = 0;
+  ws->gen = 0;
 
   if ((ws->waitseth = dds_create_waitset(DDS_CYCLONEDDS_HANDLE)) < 0) {
     RMW_SET_ERROR_MSG("failed to create waitset");
@@ -2664,6 +4346,12 @@ extern "C" rmw_ret_t rmw_destroy_wait_set(rmw_wait_set_t * wait_set)
   auto result = RMW_RET_OK;
   auto ws = static_cast<CddsWaitset *>(wait_set->data);
   RET_NULL(ws);
+  {
+    /* keep entities being deleted from touching it while it removes itself from theirs */
+    std::lock_guard<std::mutex> lock(ws->lock);
+    ws->inuse = true;
+  }
+  waitset_detach(ws);
   dds_delete(ws->waitseth);
   {
     std::lock_guard<std::mutex> lock(gcdds.lock);
@@ -2714,50 +4402,126 @@ static bool require_reattach(
   }
 }
 
-static void waitset_detach(CddsWaitset * ws)
+/* Attaches cond to the waitset unless it already is, marks it as used in the current call and
+   returns its slot */
+static size_t waitset_attach(
+  CddsWaitset * ws, dds_entity_t cond,
+  const std::shared_ptr<CddsWaitsetRefs> & refs)
 {
-  for (auto && x : ws->subs) {
-    dds_waitset_detach(ws->waitseth, x->rdcondh);
+  size_t slot;
+  auto it = ws->attached.find(cond);
+  if (it != ws->attached.end()) {
+    slot = it->second;
+  } else {
+    if (!ws->free_slots.empty()) {
+      slot = ws->free_slots.back();
+      ws->free_slots.pop_back();
+    } else {
+      slot = ws->slots.size();
+      ws->slots.emplace_back();
+    }
+    ws->slots[slot] = CddsWaitsetSlot();
+    ws->slots[slot].cond = cond;
+    ws->attached.emplace(cond, slot);
+    dds_waitset_attach(ws->waitseth, cond, static_cast<dds_attach_t>(slot));
+    if (refs) {
+      std::lock_guard<std::mutex> lock(refs->lock);
+      refs->waitsets.push_back(ws);
+      ws->slots[slot].refs = refs;
+    }
   }
-  for (auto && x : ws->gcs) {
-    dds_waitset_detach(ws->waitseth, x->gcondh);
+  ws->slots[slot].gen = ws->gen;
+  return slot;
+}
+
+/* Removes the waitset from the waitsets of the entity of a slot that is being freed */
+static void waitset_unref(CddsWaitset * ws, CddsWaitsetSlot & s)
+{
+  if (s.refs) {
+    /* the slot may hold the last reference, so release it only after unlocking */
+    const std::shared_ptr<CddsWaitsetRefs> refs = std::move(s.refs);
+    std::lock_guard<std::mutex> lock(refs->lock);
+    auto & wss = refs->waitsets;
+    wss.erase(std::remove(wss.begin(), wss.end(), ws), wss.end());
   }
-  for (auto && x : ws->srvs) {
-    dds_waitset_detach(ws->waitseth, x->service.sub->rdcondh);
+}
+
+/* Detaches the conditions not used in the current call */
+static void waitset_detach_stale(CddsWaitset * ws)
+{
+  for (size_t slot = 0; slot < ws->slots.size(); slot++) {
+    auto & s = ws->slots[slot];
+    if (s.cond != 0 && s.gen != ws->gen) {
+      dds_waitset_detach(ws->waitseth, s.cond);
+      waitset_unref(ws, s);
+      ws->attached.erase(s.cond);
+      s.cond = 0;
+      ws->free_slots.push_back(slot);
+    }
   }
-  for (auto && x : ws->cls) {
-    dds_waitset_detach(ws->waitseth, x->client.sub->rdcondh);
+}
+
+static void waitset_detach(CddsWaitset * ws)
+{
+  for (auto && s : ws->slots) {
+    if (s.cond != 0) {
+      dds_waitset_detach(ws->waitseth, s.cond);
+      waitset_unref(ws, s);
+    }
   }
+  ws->slots.resize(0);
+  ws->free_slots.resize(0);
+  ws->attached.clear();
+  ws->entry_slots.resize(0);
   ws->subs.resize(0);
   ws->gcs.resize(0);
   ws->srvs.resize(0);
   ws->cls.resize(0);
-  ws->nelems = 0;
-}
-
-static void clean_waitset_caches()
-{
-  /* Called whenever a subscriber, guard condition, service or client is deleted (as these may
-     have been cached in a waitset), and drops all cached entities from all waitsets (just to keep
-     life simple). I'm assuming one is not allowed to delete an entity while it is still being
-     used ... */
-  std::lock_guard<std::mutex> lock(gcdds.lock);
-  for (auto && ws : gcdds.waitsets) {
+  ws->evs.resize(0);
+}
+
+static void detach_from_waitsets(
+  const std::shared_ptr<CddsWaitsetRefs> & refs,
+  dds_entity_t cond)
+{
+  /* Called whenever a subscriber, guard condition, service or client is deleted, and drops its
+     condition from the waitsets it is attached to.  As its address may get reused, the entities
+     cached by those waitsets get checked again the next time they are used.  I'm assuming one is
+     not allowed to delete an entity while it is still being used, so a waitset that is in use
+     is left alone (and drops the condition itself once it is no longer passed to it) ... */
+  std::lock_guard<std::mutex> lock(refs->lock);
+  auto & wss = refs->waitsets;
+  for (auto it = wss.begin(); it != wss.end(); ) {
+    CddsWaitset * ws = *it;
     std::lock_guard<std::mutex> wslock(ws->lock);
-    if (!ws->inuse) {
-      waitset_detach(ws);
+    if (ws->inuse) {
+      ++it;
+      continue;
     }
+    auto slot_it = ws->attached.find(cond);
+    if (slot_it != ws->attached.end()) {
+      auto & s = ws->slots[slot_it->second];
+      dds_waitset_detach(ws->waitseth, cond);
+      s.cond = 0;
+      s.refs.reset();
+      ws->free_slots.push_back(slot_it->second);
+      ws->attached.erase(slot_it);
+    }
+    ws->subs.resize(0);
+    ws->gcs.resize(0);
+    ws->srvs.resize(0);
+    ws->cls.resize(0);
+    it = wss.erase(it);
   }
 }
 
-static rmw_ret_t gather_event_entities(
-  const rmw_events_t * events,
-  std::unordered_set<dds_entity_t> & entities)
+/* Attaches the entities of the events to the waitset and sets their status masks to the
+   supported events, leaving those already set correctly alone */
+static rmw_ret_t attach_event_entities(CddsWaitset * ws, const rmw_events_t * events)
 {
   RMW_CHECK_ARGUMENT_FOR_NULL(events, RMW_RET_INVALID_ARGUMENT);
 
-  std::unordered_map<dds_entity_t, uint32_t> status_mask_map;
-
+  ws->event_slots.resize(0);
   for (size_t i = 0; i < events->event_count; ++i) {
     rmw_event_t * current_event = static_cast<rmw_event_t *>(events->events[i]);
     dds_entity_t dds_entity = static_cast<CddsEntity *>(current_event->data)->enth;
@@ -2766,17 +4530,25 @@ static rmw_ret_t gather_event_entities(
       return RMW_RET_ERROR;
     }
 
+    const size_t slot = waitset_attach(ws, dds_entity, nullptr);
+    auto & s = ws->slots[slot];
+    if (s.status_mask_gen != ws->gen) {
+      s.status_mask_gen = ws->gen;
+      s.new_status_mask = 0;
+      ws->event_slots.push_back(slot);
+    }
     if (is_event_supported(current_event->event_type)) {
-      if (status_mask_map.find(dds_entity) == status_mask_map.end()) {
-        status_mask_map[dds_entity] = 0;
-      }
-      status_mask_map[dds_entity] |= get_status_kind_from_rmw(current_event->event_type);
+      s.new_status_mask |= get_status_kind_from_rmw(current_event->event_type);
     }
   }
-  for (auto & pair : status_mask_map) {
-    // set the status condition's mask with the supported type
-    dds_set_status_mask(pair.first, pair.second);
-    entities.insert(pair.first);
+  for (auto slot : ws->event_slots) {
+    auto & s = ws->slots[slot];
+    if (!s.status_mask_set || s.status_mask != s.new_status_mask) {
+      // set the status condition's mask with the supported type
+      dds_set_status_mask(s.cond, s.new_status_mask);
+      s.status_mask = s.new_status_mask;
+      s.status_mask_set = true;
+    }
   }
 
   return RMW_RET_OK;
@@ -2833,38 +4605,36 @@ extern "C" rmw_ret_t rmw_wait(
     require_reattach(ws->cls, cls ? cls->client_count : 0, cls ? cls->clients : nullptr) ||
     require_reattach(ws->evs, evs))
   {
-    size_t nelems = 0;
-    waitset_detach(ws);
-#define ATTACH(type, var, name, cond) do { \
+    /* only attach what wasn't attached yet, and detach only what is no longer there */
+    ws->gen++;
+    ws->entry_slots.resize(0);
+#define ATTACH(type, var, name, cond, refs) do { \
     ws->var.resize(0); \
     if (var) { \
       ws->var.reserve(var->name ## _count); \
       for (size_t i = 0; i < var->name ## _count; i++) { \
         auto x = static_cast<type *>(var->name ## s[i]); \
         ws->var.push_back(x); \
-        dds_waitset_attach(ws->waitseth, x->cond, nelems); \
-        nelems++; \
+        ws->entry_slots.push_back(waitset_attach(ws, x->cond, x->refs)); \
       } \
     } \
 } \
   while (0)
-    ATTACH(CddsSubscription, subs, subscriber, rdcondh);
-    ATTACH(CddsGuardCondition, gcs, guard_condition, gcondh);
-    ATTACH(CddsService, srvs, service, service.sub->rdcondh);
-    ATTACH(CddsClient, cls, client, client.sub->rdcondh);
+    ATTACH(CddsSubscription, subs, subscriber, rdcondh, waitset_refs);
+    ATTACH(CddsGuardCondition, gcs, guard_condition, gcondh, waitset_refs);
+    ATTACH(CddsService, srvs, service, service.sub->rdcondh, service.sub->waitset_refs);
+    ATTACH(CddsClient, cls, client, client.sub->rdcondh, client.sub->waitset_refs);
 #undef ATTACH
 
     ws->evs.resize(0);
     if (evs) {
-      std::unordered_set<dds_entity_t> event_entities;
-      rmw_ret_t ret_code = gather_event_entities(evs, event_entities);
+      rmw_ret_t ret_code = attach_event_entities(ws, evs);
       if (ret_code != RMW_RET_OK) {
+        waitset_detach(ws);
+        std::lock_guard<std::mutex> lock(ws->lock);
+        ws->inuse = false;
         return ret_code;
       }
-      for (auto e : event_entities) {
-        dds_waitset_attach(ws->waitseth, e, nelems);
-        nelems++;
-      }
       ws->evs.reserve(evs->event_count);
       for (size_t i = 0; i < evs->event_count; i++) {
         auto current_event = static_cast<rmw_event_t *>(evs->events[i]);
@@ -2875,50 +4645,75 @@ extern "C" rmw_ret_t rmw_wait(
       }
     }
 
-    ws->nelems = nelems;
+    waitset_detach_stale(ws);
+  }
+
+  /* samples already taken from the reader by a subscription don't trigger its read condition,
+     so a subscription holding any means there is no point in blocking */
+  bool prefetched = false;
+  if (subs) {
+    for (size_t i = 0; i < subs->subscriber_count && !prefetched; i++) {
+      prefetched = static_cast<CddsSubscription *>(subs->subscribers[i])->prefetched.load();
+    }
   }
 
-  ws->trigs.resize(ws->nelems + 1);
   const dds_time_t timeout =
     (wait_timeout == NULL) ?
     DDS_NEVER :
     (dds_time_t) wait_timeout->sec * 1000000000 + wait_timeout->nsec;
-  ws->trigs.resize(ws->nelems + 1);
-  const dds_return_t ntrig = dds_waitset_wait(
+  ws->trigs.resize(ws->slots.size() + 1);
+  dds_return_t ntrig = dds_waitset_wait(
     ws->waitseth, ws->trigs.data(),
-    ws->trigs.size(), timeout);
-  ws->trigs.resize(ntrig);
-  std::sort(ws->trigs.begin(), ws->trigs.end());
-  ws->trigs.push_back((dds_attach_t) -1);
+    ws->trigs.size(), prefetched ? 0 : timeout);
+  if (ntrig < 0) {
+    ntrig = 0;
+  } else if (static_cast<size_t>(ntrig) > ws->trigs.size()) {
+    /* more triggered than there is room for, the others will trigger again next time */
+    ntrig = static_cast<dds_return_t>(ws->trigs.size());
+  }
+  ws->triggered.resize((ws->slots.size() + 63) / 64);
+  for (dds_return_t i = 0; i < ntrig; i++) {
+    const size_t slot = static_cast<size_t>(ws->trigs[i]);
+    if (slot < ws->slots.size()) {
+      ws->triggered[slot / 64] |= uint64_t{1} << (slot % 64);
+    }
+  }
 
   {
-    dds_attach_t trig_idx = 0;
     bool dummy;
-    size_t nelems = 0;
-#define DETACH(type, var, name, cond, on_triggered) do { \
+    size_t entry = 0;
+#define DETACH(type, var, name, on_triggered, pending) do { \
     if (var) { \
       for (size_t i = 0; i < var->name ## _count; i++) { \
         auto x = static_cast<type *>(var->name ## s[i]); \
-        if (ws->trigs[trig_idx] == static_cast<dds_attach_t>(nelems)) { \
+        const size_t slot = ws->entry_slots[entry]; \
+        if (ws->triggered[slot / 64] & (uint64_t{1} << (slot % 64))) { \
           on_triggered; \
-          trig_idx++; \
-        } else { \
+        } else if (!(pending)) { \
           var->name ## s[i] = nullptr; \
         } \
-        nelems++; \
+        entry++; \
       } \
     } \
 } while (0)
-    DETACH(CddsSubscription, subs, subscriber, rdcondh, (void) x);
+    DETACH(CddsSubscription, subs, subscriber, (void) x, x->prefetched.load());
     DETACH(
-      CddsGuardCondition, gcs, guard_condition, gcondh,
-      dds_take_guardcondition(x->gcondh, &dummy));
-    DETACH(CddsService, srvs, service, service.sub->rdcondh, (void) x);
-    DETACH(CddsClient, cls, client, client.sub->rdcondh, (void) x);
+      CddsGuardCondition, gcs, guard_condition,
+      dds_take_guardcondition(x->gcondh, &dummy), false);
+    DETACH(CddsService, srvs, service, (void) x, false);
+    DETACH(CddsClient, cls, client, (void) x, false);
 #undef DETACH
     handle_active_events(evs);
   }
 
+  /* clear only the bits that got set */
+  for (dds_return_t i = 0; i < ntrig; i++) {
+    const size_t slot = static_cast<size_t>(ws->trigs[i]);
+    if (slot < ws->slots.size()) {
+      ws->triggered[slot / 64] &= ~(uint64_t{1} << (slot % 64));
+    }
+  }
+
 #if REPORT_BLOCKED_REQUESTS
   for (auto const & c : ws->cls) {
     check_for_blocked_requests(*c);
@@ -2930,7 +4725,7 @@ extern "C" rmw_ret_t rmw_wait(
     ws->inuse = false;
   }
 
-  return (ws->trigs.size() == 1) ? RMW_RET_TIMEOUT : RMW_RET_OK;
+  return (ntrig == 0 && !prefetched) ? RMW_RET_TIMEOUT : RMW_RET_OK;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -3035,7 +4830,9 @@ static rmw_ret_t rmw_send_response_request(
   const void * ros_data)
 {
   const cdds_request_wrapper_t wrap = {header, const_cast<void *>(ros_data)};
+  const write_batching_state write_batching = get_write_batching_state();
   if (dds_write(cs->pub->enth, static_cast<const void *>(&wrap)) >= 0) {
+    after_write(cs->pub, write_batching);
     return RMW_RET_OK;
   } else {
     RMW_SET_ERROR_MSG("cannot publish data");
@@ -3234,7 +5031,7 @@ static rmw_ret_t destroy_client(const rmw_node_t * node, rmw_client_t * client)
   RET_WRONG_IMPLID(node);
   RET_WRONG_IMPLID(client);
   auto info = static_cast<CddsClient *>(client->data);
-  clean_waitset_caches();
+  detach_from_waitsets(info->client.sub->waitset_refs, info->client.sub->rdcondh);
 
   {
     // Update graph
@@ -3326,7 +5123,7 @@ static rmw_ret_t destroy_service(const rmw_node_t * node, rmw_service_t * servic
   RET_WRONG_IMPLID(node);
   RET_WRONG_IMPLID(service);
   auto info = static_cast<CddsService *>(service->data);
-  clean_waitset_caches();
+  detach_from_waitsets(info->service.sub->waitset_refs, info->service.sub->rdcondh);
 
   {
     // Update graph
@@ -15,13 +15,19 @@
 
 #include <rmw/allocators.h>
 
+#include <algorithm>
 #include <cstring>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <regex>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
+#include "DeepCopy.hpp"
 #include "Serialization.hpp"
 #include "TypeSupport2.hpp"
 #include "bytewise.hpp"
@@ -30,6 +36,7 @@
 #include "rmw_cyclonedds_cpp/MessageTypeSupport.hpp"
 #include "rmw_cyclonedds_cpp/ServiceTypeSupport.hpp"
 #include "rmw_cyclonedds_cpp/serdes.hpp"
+#include "shm_transport.hpp"
 
 /* Cyclone's nn_keyhash got renamed to ddsi_keyhash and shuffled around in the header
    files to avoid pulling in tons of things just for a definition of a keyhash.  This
@@ -43,6 +50,21 @@
 #define ddsi_keyhash nn_keyhash
 #endif
 
+/* Streaming payloads reference runs of at least this many bytes in the sample instead of
+   copying them */
+static constexpr size_t streaming_min_ref_size = 256;
+
+struct serdata_rmw_streaming
+{
+  std::mutex lock;
+  rmw_cyclonedds_cpp::CDRSegmentList segments;
+  /* buffers handed out by to_ser_ref, keyed on the address returned */
+  std::unordered_map<const void *, std::unique_ptr<byte[]>> scratch;
+  /* for a native serdata, the copy of the sample it owns; the segments then only get computed
+     once the payload is needed */
+  std::unique_ptr<void, std::function<void(void *)>> sample;
+};
+
 using MessageTypeSupport_c =
   rmw_cyclonedds_cpp::MessageTypeSupport<rosidl_typesupport_introspection_c__MessageMembers>;
 using MessageTypeSupport_cpp =
@@ -222,6 +244,82 @@ static struct ddsi_serdata * serdata_rmw_from_sample(
   }
 }
 
+struct ddsi_serdata * serdata_rmw_from_sample_streaming(
+  const struct ddsi_sertopic * topiccmn,
+  const void * sample, size_t streaming_threshold)
+{
+  try {
+    const struct sertopic_rmw * topic = static_cast<const struct sertopic_rmw *>(topiccmn);
+    assert(!topic->is_request_header);
+    auto d = std::make_unique<serdata_rmw>(topic, SDK_DATA);
+    size_t sz = topic->cdr_writer->get_serialized_size(sample);
+    if (sz < streaming_threshold) {
+      d->resize(sz);
+      topic->cdr_writer->serialize(d->data(), sample);
+    } else {
+      auto streaming = std::make_unique<serdata_rmw_streaming>();
+      topic->cdr_writer->serialize_segments(streaming->segments, sample, streaming_min_ref_size);
+      assert(streaming->segments.serialized_size() == sz);
+      d->set_streaming(std::move(streaming), sz);
+    }
+    return d.release();
+  } catch (std::exception & e) {
+    RMW_SET_ERROR_MSG(e.what());
+    return nullptr;
+  }
+}
+
+void serdata_rmw_release_sample(struct ddsi_serdata * dcmn)
+{
+  auto d = static_cast<serdata_rmw *>(dcmn);
+  /* The caller holds one reference, any other one means DDSI retained the serdata (writer
+     history, local readers, packets queued for transmission) and so it must no longer depend
+     on the sample.  If there are none, nobody can acquire a new one either. */
+  if (d->is_streaming() && d->native_sample() == nullptr && ddsrt_atomic_ld32(&d->refc) > 1) {
+    d->materialize();
+  }
+}
+
+struct ddsi_serdata * serdata_rmw_from_sample_native(
+  const struct ddsi_sertopic * topiccmn,
+  const void * sample)
+{
+  try {
+    const struct sertopic_rmw * topic = static_cast<const struct sertopic_rmw *>(topiccmn);
+    assert(!topic->is_request_header && topic->copier);
+    auto d = std::make_unique<serdata_rmw>(topic, SDK_DATA);
+    size_t sz = topic->cdr_writer->get_serialized_size(sample);
+    const rmw_cyclonedds_cpp::BaseDeepCopier * copier = topic->copier.get();
+    auto streaming = std::make_unique<serdata_rmw_streaming>();
+    streaming->sample = {copier->make_message(), [copier](void * msg) {
+        copier->destroy_message(msg);
+      }};
+    copier->copy(streaming->sample.get(), sample);
+    d->set_streaming(std::move(streaming), sz);
+    return d.release();
+  } catch (std::exception & e) {
+    RMW_SET_ERROR_MSG(e.what());
+    return nullptr;
+  }
+}
+
+struct ddsi_serdata * serdata_rmw_from_sample_flat(
+  const struct ddsi_sertopic * topiccmn,
+  const void * sample)
+{
+  try {
+    const struct sertopic_rmw * topic = static_cast<const struct sertopic_rmw *>(topiccmn);
+    assert(!topic->is_request_header && topic->copier);
+    const size_t sz = topic->copier->flat_size(sample);
+    auto payload = serdata_rmw_allocate_payload(sz + (0 - sz) % 4);
+    topic->copier->flatten(payload.get(), sample);
+    return serdata_rmw_from_shared_payload(topic, std::move(payload), sz);
+  } catch (std::exception & e) {
+    RMW_SET_ERROR_MSG(e.what());
+    return nullptr;
+  }
+}
+
 struct ddsi_serdata * serdata_rmw_from_serialized_message(
   const struct ddsi_sertopic * topiccmn,
   const void * raw, size_t size)
@@ -233,6 +331,52 @@ struct ddsi_serdata * serdata_rmw_from_serialized_message(
   return d;
 }
 
+std::shared_ptr<byte> serdata_rmw_allocate_payload(size_t size)
+{
+  /* operator new gives memory aligned for any fundamental type, skipping 4 bytes at the start
+     therefore aligns the message after the encapsulation header */
+  std::shared_ptr<byte> buf(new byte[size + 4], std::default_delete<byte[]>());
+  return std::shared_ptr<byte>(buf, buf.get() + 4);
+}
+
+std::shared_ptr<byte> serdata_rmw_allocate_payload(
+  size_t size,
+  const rcutils_allocator_t & allocator)
+{
+  void * mem = allocator.allocate(size + 4, allocator.state);
+  if (mem == nullptr) {
+    throw std::bad_alloc();
+  }
+  std::shared_ptr<byte> buf(
+    static_cast<byte *>(mem), [allocator](byte * ptr) {
+      allocator.deallocate(ptr, allocator.state);
+    });
+  return std::shared_ptr<byte>(buf, buf.get() + 4);
+}
+
+struct ddsi_serdata * serdata_rmw_from_shared_payload(
+  const struct ddsi_sertopic * topiccmn,
+  std::shared_ptr<byte> payload, size_t size)
+{
+  const struct sertopic_rmw * topic = static_cast<const struct sertopic_rmw *>(topiccmn);
+  auto d = new serdata_rmw(topic, SDK_DATA);
+  d->set_payload(std::move(payload), size);
+  return d;
+}
+
+struct ddsi_serdata * serdata_rmw_share_payload(
+  const struct ddsi_sertopic * topiccmn,
+  const struct ddsi_serdata * dcmn)
+{
+  const struct sertopic_rmw * topic = static_cast<const struct sertopic_rmw *>(topiccmn);
+  auto d = static_cast<const serdata_rmw *>(dcmn);
+  assert(!d->is_streaming());
+  auto d1 = new serdata_rmw(topic, SDK_DATA);
+  /* the size is padded already, so set_payload doesn't touch the shared payload */
+  d1->set_payload(d->shared_data(), d->size());
+  return d1;
+}
+
 static struct ddsi_serdata * serdata_rmw_to_topicless(const struct ddsi_serdata * dcmn)
 {
   auto d = static_cast<const serdata_rmw *>(dcmn);
@@ -244,7 +388,7 @@ static struct ddsi_serdata * serdata_rmw_to_topicless(const struct ddsi_serdata
 static void serdata_rmw_to_ser(const struct ddsi_serdata * dcmn, size_t off, size_t sz, void * buf)
 {
   auto d = static_cast<const serdata_rmw *>(dcmn);
-  memcpy(buf, byte_offset(d->data(), off), sz);
+  d->copy_out(off, sz, buf);
 }
 
 static struct ddsi_serdata * serdata_rmw_to_ser_ref(
@@ -252,15 +396,29 @@ static struct ddsi_serdata * serdata_rmw_to_ser_ref(
   size_t sz, ddsrt_iovec_t * ref)
 {
   auto d = static_cast<const serdata_rmw *>(dcmn);
-  ref->iov_base = byte_offset(d->data(), off);
+  ref->iov_base = const_cast<void *>(d->ref_out(off, sz));
   ref->iov_len = (ddsrt_iov_len_t) sz;
   return ddsi_serdata_ref(d);
 }
 
 static void serdata_rmw_to_ser_unref(struct ddsi_serdata * dcmn, const ddsrt_iovec_t * ref)
 {
-  static_cast<void>(ref);    // unused
-  ddsi_serdata_unref(static_cast<serdata_rmw *>(dcmn));
+  auto d = static_cast<serdata_rmw *>(dcmn);
+  d->unref_out(ref->iov_base);
+  ddsi_serdata_unref(d);
+}
+
+/* Runs f on a contiguous copy of the payload, which for a streaming serdata that has not been
+   materialized means serializing it into a temporary buffer */
+template<typename Func>
+static auto with_contiguous_payload(const serdata_rmw * d, Func f)
+{
+  if (!d->is_streaming()) {
+    return f(d->data(), d->size());
+  }
+  std::unique_ptr<byte[]> buf(new byte[d->size()]);
+  d->copy_out(0, d->size(), buf.get());
+  return f(static_cast<void *>(buf.get()), d->size());
 }
 
 static bool serdata_rmw_to_sample(
@@ -277,16 +435,34 @@ static bool serdata_rmw_to_sample(
     if (d->kind != SDK_DATA) {
       /* ROS2 doesn't do keys in a meaningful way yet */
     } else if (!topic->is_request_header) {
-      cycdeser sd(d->data(), d->size());
-      if (using_introspection_c_typesupport(topic->type_support.typesupport_identifier_)) {
-        auto typed_typesupport =
-          static_cast<MessageTypeSupport_c *>(topic->type_support.type_support_);
-        return typed_typesupport->deserializeROSmessage(sd, sample);
-      } else if (using_introspection_cpp_typesupport(topic->type_support.typesupport_identifier_)) {
-        auto typed_typesupport =
-          static_cast<MessageTypeSupport_cpp *>(topic->type_support.type_support_);
-        return typed_typesupport->deserializeROSmessage(sd, sample);
+      if (const void * native = d->native_sample()) {
+        topic->copier->copy(sample, native);
+        return true;
+      }
+      auto deserialize = [topic, sample](const void * data, size_t size) {
+          if (rmw_cyclonedds_cpp::is_flat_payload(data, size)) {
+            return topic->copier->unflatten(sample, data, size);
+          }
+          cycdeser sd(data, size);
+          if (using_introspection_c_typesupport(topic->type_support.typesupport_identifier_)) {
+            auto typed_typesupport =
+              static_cast<MessageTypeSupport_c *>(topic->type_support.type_support_);
+            return typed_typesupport->deserializeROSmessage(sd, sample);
+          } else if (
+            using_introspection_cpp_typesupport(topic->type_support.typesupport_identifier_))
+          {
+            auto typed_typesupport =
+              static_cast<MessageTypeSupport_cpp *>(topic->type_support.type_support_);
+            return typed_typesupport->deserializeROSmessage(sd, sample);
+          }
+          return false;
+        };
+      if (!d->is_streaming() && shm_is_descriptor(d->data(), d->size())) {
+        /* deserialize in place from the publisher's shared memory; false if the sample has been
+           overwritten in the meantime */
+        return shm_with_sample(d->data(), d->size(), deserialize);
       }
+      return with_contiguous_payload(d, deserialize);
     } else {
       /* The "prefix" lambda is there to inject the service invocation header data into the CDR
         stream -- I haven't checked how it is done in the official RMW implementations, so it is
@@ -310,6 +486,9 @@ static bool serdata_rmw_to_sample(
   } catch (std::runtime_error & e) {
     RMW_SET_ERROR_MSG(e.what());
     return false;
+  } catch (std::bad_alloc & e) {
+    RMW_SET_ERROR_MSG(e.what());
+    return false;
   }
 
   return false;
@@ -348,16 +527,27 @@ static size_t serdata_rmw_print(
       /* ROS2 doesn't do keys in a meaningful way yet */
       return static_cast<size_t>(snprintf(buf, bufsize, ":k:{}"));
     } else if (!topic->is_request_header) {
-      cycprint sd(buf, bufsize, d->data(), d->size());
-      if (using_introspection_c_typesupport(topic->type_support.typesupport_identifier_)) {
-        auto typed_typesupport =
-          static_cast<MessageTypeSupport_c *>(topic->type_support.type_support_);
-        return typed_typesupport->printROSmessage(sd);
-      } else if (using_introspection_cpp_typesupport(topic->type_support.typesupport_identifier_)) {
-        auto typed_typesupport =
-          static_cast<MessageTypeSupport_cpp *>(topic->type_support.type_support_);
-        return typed_typesupport->printROSmessage(sd);
+      if (!d->is_streaming() && shm_is_descriptor(d->data(), d->size())) {
+        return static_cast<size_t>(snprintf(buf, bufsize, "(in shared memory)"));
+      } else if (!d->is_streaming() && rmw_cyclonedds_cpp::is_flat_payload(d->data(), d->size())) {
+        return static_cast<size_t>(snprintf(buf, bufsize, "(native flat)"));
       }
+      return with_contiguous_payload(
+        d, [topic, buf, bufsize](const void * data, size_t size) -> size_t {
+          cycprint sd(buf, bufsize, data, size);
+          if (using_introspection_c_typesupport(topic->type_support.typesupport_identifier_)) {
+            auto typed_typesupport =
+              static_cast<MessageTypeSupport_c *>(topic->type_support.type_support_);
+            return typed_typesupport->printROSmessage(sd);
+          } else if (
+            using_introspection_cpp_typesupport(topic->type_support.typesupport_identifier_))
+          {
+            auto typed_typesupport =
+              static_cast<MessageTypeSupport_cpp *>(topic->type_support.type_support_);
+            return typed_typesupport->printROSmessage(sd);
+          }
+          return 0;
+        });
     } else {
       /* The "prefix" lambda is there to inject the service invocation header data into the CDR
         stream -- I haven't checked how it is done in the official RMW implementations, so it is
@@ -383,6 +573,9 @@ static size_t serdata_rmw_print(
   } catch (std::runtime_error & e) {
     RMW_SET_ERROR_MSG(e.what());
     return false;
+  } catch (std::bad_alloc & e) {
+    RMW_SET_ERROR_MSG(e.what());
+    return false;
   }
 
   return false;
@@ -576,6 +769,9 @@ struct sertopic_rmw * create_sertopic(
   st->type_support.type_support_ = type_support;
   st->is_request_header = is_request_header;
   st->cdr_writer = rmw_cyclonedds_cpp::make_cdr_writer(std::move(message_type));
+  if (!is_request_header) {
+    st->copier = rmw_cyclonedds_cpp::make_deep_copier(st->cdr_writer->value_type());
+  }
   return st;
 }
 
@@ -590,15 +786,113 @@ void serdata_rmw::resize(size_t requested_size)
   /* FIXME: CDR padding in DDSI makes me do this to avoid reading beyond the bounds
   when copying data to network.  Should fix Cyclone to handle that more elegantly.  */
   size_t n_pad_bytes = (0 - requested_size) % 4;
-  m_data.reset(new byte[requested_size + n_pad_bytes]);
+  m_data = serdata_rmw_allocate_payload(requested_size + n_pad_bytes);
   m_size = requested_size + n_pad_bytes;
 
   // zero the very end. The caller isn't necessarily going to overwrite it.
   std::memset(byte_offset(m_data.get(), requested_size), '\0', n_pad_bytes);
 }
 
+void serdata_rmw::set_payload(std::shared_ptr<byte> payload, size_t size)
+{
+  size_t n_pad_bytes = (0 - size) % 4;
+  std::memset(byte_offset(payload.get(), size), '\0', n_pad_bytes);
+  m_data = std::move(payload);
+  m_size = size + n_pad_bytes;
+}
+
 serdata_rmw::serdata_rmw(const ddsi_sertopic * topic, ddsi_serdata_kind kind)
 : ddsi_serdata{}
 {
   ddsi_serdata_init(this, topic, kind);
 }
+
+serdata_rmw::~serdata_rmw() = default;
+
+void serdata_rmw::set_streaming(std::unique_ptr<serdata_rmw_streaming> streaming, size_t size)
+{
+  /* same padding as resize(): the bytes beyond the serialized data read as zeros */
+  m_size = size + (0 - size) % 4;
+  m_data.reset();
+  m_streaming = std::move(streaming);
+}
+
+void serdata_rmw::copy_out(size_t off, size_t sz, void * buf) const
+{
+  assert(off + sz <= m_size);
+  if (!m_streaming) {
+    memcpy(buf, byte_offset(m_data.get(), off), sz);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_streaming->lock);
+  if (m_data) {
+    memcpy(buf, byte_offset(m_data.get(), off), sz);
+    return;
+  }
+  prepare_segments();
+  size_t avail = m_streaming->segments.serialized_size();
+  size_t n_bytes = (off >= avail) ? 0 : std::min(sz, avail - off);
+  if (n_bytes > 0) {
+    m_streaming->segments.copy_out(off, n_bytes, buf);
+  }
+  memset(byte_offset(buf, n_bytes), 0, sz - n_bytes);
+}
+
+const void * serdata_rmw::ref_out(size_t off, size_t sz) const
+{
+  if (!m_streaming) {
+    return byte_offset(m_data.get(), off);
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_streaming->lock);
+    if (m_data) {
+      return byte_offset(m_data.get(), off);
+    }
+  }
+  std::unique_ptr<byte[]> buf(new byte[sz]);
+  copy_out(off, sz, buf.get());
+  const void * ref = buf.get();
+  std::lock_guard<std::mutex> lock(m_streaming->lock);
+  m_streaming->scratch.emplace(ref, std::move(buf));
+  return ref;
+}
+
+void serdata_rmw::unref_out(const void * ref) const
+{
+  if (m_streaming) {
+    std::lock_guard<std::mutex> lock(m_streaming->lock);
+    m_streaming->scratch.erase(ref);
+  }
+}
+
+void serdata_rmw::materialize()
+{
+  if (!m_streaming) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_streaming->lock);
+  if (m_data) {
+    return;
+  }
+  prepare_segments();
+  std::shared_ptr<byte> buf = serdata_rmw_allocate_payload(m_size);
+  size_t n_bytes = m_streaming->segments.serialized_size();
+  m_streaming->segments.copy_out(0, n_bytes, buf.get());
+  memset(byte_offset(buf.get(), n_bytes), 0, m_size - n_bytes);
+  m_data = std::move(buf);
+  m_streaming->segments = rmw_cyclonedds_cpp::CDRSegmentList{};
+}
+
+const void * serdata_rmw::native_sample() const
+{
+  return m_streaming ? m_streaming->sample.get() : nullptr;
+}
+
+void serdata_rmw::prepare_segments() const
+{
+  if (m_streaming->sample && m_streaming->segments.segments.empty()) {
+    auto st = static_cast<const struct sertopic_rmw *>(topic);
+    st->cdr_writer->serialize_segments(
+      m_streaming->segments, m_streaming->sample.get(), streaming_min_ref_size);
+  }
+}
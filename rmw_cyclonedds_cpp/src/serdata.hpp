@@ -21,10 +21,12 @@
 #include "bytewise.hpp"
 #include "dds/ddsi/ddsi_serdata.h"
 #include "dds/ddsi/ddsi_sertopic.h"
+#include "rcutils/allocator.h"
 
 namespace rmw_cyclonedds_cpp
 {
 class BaseCDRWriter;
+class BaseDeepCopier;
 }
 
 struct CddsTypeSupport
@@ -33,6 +35,10 @@ struct CddsTypeSupport
   const char * typesupport_identifier_;
 };
 
+/* State of a serdata whose payload is produced on demand from a sample rather than stored in
+   a buffer, see serdata_rmw_from_sample_streaming and serdata_rmw_from_sample_native */
+struct serdata_rmw_streaming;
+
 struct sertopic_rmw : ddsi_sertopic
 {
   CddsTypeSupport type_support;
@@ -43,6 +49,8 @@ struct sertopic_rmw : ddsi_sertopic
   std::string cpp_name_type_name;
 #endif
   std::unique_ptr<const rmw_cyclonedds_cpp::BaseCDRWriter> cdr_writer;
+  /* null for request/response topics */
+  std::unique_ptr<const rmw_cyclonedds_cpp::BaseDeepCopier> copier;
 };
 
 class serdata_rmw : public ddsi_serdata
@@ -51,13 +59,36 @@ protected:
   size_t m_size {0};
   /* first two bytes of data is CDR encoding
      second two bytes are encoding options */
-  std::unique_ptr<byte[]> m_data {nullptr};
+  std::shared_ptr<byte> m_data {nullptr};
+  /* non-null if the payload is serialized on demand rather than stored in m_data; m_data
+     gets set (under the lock in m_streaming) once the payload is materialized */
+  std::unique_ptr<serdata_rmw_streaming> m_streaming {nullptr};
+
+  /* computes the segments of a native serdata if not done yet, requires the streaming lock */
+  void prepare_segments() const;
 
 public:
   serdata_rmw(const ddsi_sertopic * topic, ddsi_serdata_kind kind);
+  ~serdata_rmw();
   void resize(size_t requested_size);
+  /* use payload (of which the first size bytes are valid) as the serialized data */
+  void set_payload(std::shared_ptr<byte> payload, size_t size);
   size_t size() const {return m_size;}
   void * data() const {return m_data.get();}
+  const std::shared_ptr<byte> & shared_data() const {return m_data;}
+
+  bool is_streaming() const {return m_streaming != nullptr;}
+  void set_streaming(std::unique_ptr<serdata_rmw_streaming> streaming, size_t size);
+  /* the copy of the sample owned by a native serdata, null otherwise */
+  const void * native_sample() const;
+  /* copy a range of the payload, serializing it from the sample if needed */
+  void copy_out(size_t off, size_t sz, void * buf) const;
+  /* pointer to a range of the payload, valid until the matching unref_out */
+  const void * ref_out(size_t off, size_t sz) const;
+  void unref_out(const void * ref) const;
+  /* serialize the full payload into m_data, dropping all references to a sample it does not
+     own; it is safe to use data() afterwards */
+  void materialize();
 };
 
 typedef struct cdds_request_header
@@ -91,4 +122,48 @@ struct ddsi_serdata * serdata_rmw_from_serialized_message(
   const struct ddsi_sertopic * topiccmn,
   const void * raw, size_t size);
 
+/* Allocates a buffer for a payload of size bytes, such that the message following the 4-byte
+   encapsulation header is 8-byte aligned; the second form takes the memory from allocator */
+std::shared_ptr<byte> serdata_rmw_allocate_payload(size_t size);
+std::shared_ptr<byte> serdata_rmw_allocate_payload(
+  size_t size,
+  const rcutils_allocator_t & allocator);
+
+/* Like serdata_rmw_from_serialized_message, but sharing the payload instead of copying it.  The
+   payload must have room for padding size to a multiple of 4, the padding gets zeroed. */
+struct ddsi_serdata * serdata_rmw_from_shared_payload(
+  const struct ddsi_sertopic * topiccmn,
+  std::shared_ptr<byte> payload, size_t size);
+
+/* A new serdata for topic with the same payload as d, which must not be streaming and must be
+   of a topic of the same type.  Every write needs a serdata of its own for the timestamp, this
+   makes writing the same data repeatedly, or to several writers, cheap. */
+struct ddsi_serdata * serdata_rmw_share_payload(
+  const struct ddsi_sertopic * topiccmn,
+  const struct ddsi_serdata * dcmn);
+
+/* Like serdata_rmw_from_sample, but if the serialized size is at least streaming_threshold, the
+   serdata references the sample and serializes ranges of it as DDSI requests them.  The caller
+   must keep a reference and call serdata_rmw_release_sample before the sample goes away. */
+struct ddsi_serdata * serdata_rmw_from_sample_streaming(
+  const struct ddsi_sertopic * topiccmn,
+  const void * sample, size_t streaming_threshold);
+
+/* Detach a serdata from the sample it was created from, materializing the payload if something
+   other than the caller still holds a reference to it */
+void serdata_rmw_release_sample(struct ddsi_serdata * dcmn);
+
+/* A serdata holding a deep copy of the sample instead of its serialized form, for delivery to
+   readers in the same process: converting it to a sample is a copy, and it only gets
+   serialized if DDSI needs the payload after all */
+struct ddsi_serdata * serdata_rmw_from_sample_native(
+  const struct ddsi_sertopic * topiccmn,
+  const void * sample);
+
+/* A serdata holding the sample in the native flat representation instead of CDR, for readers
+   that have the same layout of the type (see rmw_cyclonedds_cpp::is_flat_payload) */
+struct ddsi_serdata * serdata_rmw_from_sample_flat(
+  const struct ddsi_sertopic * topiccmn,
+  const void * sample);
+
 #endif  // SERDATA_HPP_
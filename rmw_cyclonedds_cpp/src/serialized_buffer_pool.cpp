@@ -0,0 +1,169 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "serialized_buffer_pool.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+/* Every block starts with a header recording its capacity, as the rcutils deallocate function
+   doesn't get told the size; it is padded to keep the buffer maximally aligned */
+union block_header
+{
+  size_t capacity;
+  std::max_align_t align;
+};
+
+static block_header * header_of(void * pointer)
+{
+  return static_cast<block_header *>(pointer) - 1;
+}
+
+static void * buffer_of(block_header * hdr)
+{
+  return static_cast<void *>(hdr + 1);
+}
+
+SerializedBufferPool::Ptr SerializedBufferPool::create(size_t max_cached)
+{
+  return Ptr(new SerializedBufferPool(max_cached));
+}
+
+SerializedBufferPool::SerializedBufferPool(size_t max_cached)
+: m_refc(1), m_max_cached(max_cached)
+{
+}
+
+SerializedBufferPool::~SerializedBufferPool()
+{
+  for (auto blk : m_free) {
+    std::free(blk);
+  }
+}
+
+void SerializedBufferPool::ref()
+{
+  m_refc.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SerializedBufferPool::unref()
+{
+  if (m_refc.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete this;
+  }
+}
+
+rcutils_allocator_t SerializedBufferPool::get_allocator()
+{
+  rcutils_allocator_t allocator = rcutils_get_zero_initialized_allocator();
+  allocator.allocate = allocate_cb;
+  allocator.deallocate = deallocate_cb;
+  allocator.reallocate = reallocate_cb;
+  allocator.zero_allocate = zero_allocate_cb;
+  allocator.state = this;
+  return allocator;
+}
+
+size_t SerializedBufferPool::capacity_of(const rcutils_allocator_t & allocator, void * buffer)
+{
+  if (allocator.allocate != allocate_cb || buffer == nullptr) {
+    return 0;
+  }
+  return header_of(buffer)->capacity;
+}
+
+void * SerializedBufferPool::allocate(size_t size)
+{
+  block_header * hdr = nullptr;
+  size += (0 - size) % 4;
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    /* messages on a topic tend to be of similar size, so the first one that fits is fine */
+    for (auto it = m_free.begin(); it != m_free.end(); ++it) {
+      if (static_cast<block_header *>(*it)->capacity >= size) {
+        hdr = static_cast<block_header *>(*it);
+        m_free.erase(it);
+        break;
+      }
+    }
+  }
+  if (hdr == nullptr) {
+    if ((hdr = static_cast<block_header *>(std::malloc(sizeof(*hdr) + size))) == nullptr) {
+      return nullptr;
+    }
+    hdr->capacity = size;
+  }
+  ref();
+  return buffer_of(hdr);
+}
+
+void SerializedBufferPool::deallocate(void * pointer)
+{
+  if (pointer == nullptr) {
+    return;
+  }
+  block_header * hdr = header_of(pointer);
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_free.size() < m_max_cached) {
+      m_free.push_back(hdr);
+      hdr = nullptr;
+    }
+  }
+  std::free(hdr);
+  unref();
+}
+
+void * SerializedBufferPool::reallocate(void * pointer, size_t size)
+{
+  if (pointer == nullptr) {
+    return allocate(size);
+  }
+  block_header * hdr = header_of(pointer);
+  if (hdr->capacity >= size) {
+    return pointer;
+  }
+  void * newptr = allocate(size);
+  if (newptr != nullptr) {
+    memcpy(newptr, pointer, hdr->capacity);
+    deallocate(pointer);
+  }
+  return newptr;
+}
+
+void * SerializedBufferPool::allocate_cb(size_t size, void * state)
+{
+  return static_cast<SerializedBufferPool *>(state)->allocate(size);
+}
+
+void SerializedBufferPool::deallocate_cb(void * pointer, void * state)
+{
+  static_cast<SerializedBufferPool *>(state)->deallocate(pointer);
+}
+
+void * SerializedBufferPool::reallocate_cb(void * pointer, size_t size, void * state)
+{
+  return static_cast<SerializedBufferPool *>(state)->reallocate(pointer, size);
+}
+
+void * SerializedBufferPool::zero_allocate_cb(
+  size_t number_of_elements, size_t size_of_element,
+  void * state)
+{
+  const size_t size = number_of_elements * size_of_element;
+  void * pointer = static_cast<SerializedBufferPool *>(state)->allocate(size);
+  if (pointer != nullptr) {
+    memset(pointer, 0, size);
+  }
+  return pointer;
+}
@@ -0,0 +1,73 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SERIALIZED_BUFFER_POOL_HPP_
+#define SERIALIZED_BUFFER_POOL_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "rcutils/allocator.h"
+
+/* Recycles buffers for serialized messages.  The pool hands out an rcutils allocator, so that a
+   pooled buffer is an ordinary rmw_serialized_message_t that can be resized, finalized or
+   adopted by the publisher like any other; deallocating it returns it to the pool.
+
+   The pool is reference counted and every outstanding buffer holds a reference, so buffers may
+   outlive the entity that created the pool. */
+class SerializedBufferPool
+{
+public:
+  struct Unref
+  {
+    void operator()(SerializedBufferPool * pool) const {pool->unref();}
+  };
+  using Ptr = std::unique_ptr<SerializedBufferPool, Unref>;
+
+  /* at most max_cached unused buffers are kept */
+  static Ptr create(size_t max_cached);
+
+  rcutils_allocator_t get_allocator();
+
+  /* The capacity of a buffer allocated using allocator if that is the allocator of a pool, else
+     0.  Buffers are allocated in multiples of 4 bytes, as DDSI may read a serialized message up
+     to the next multiple of 4, so it may exceed the capacity that was asked for. */
+  static size_t capacity_of(const rcutils_allocator_t & allocator, void * buffer);
+
+private:
+  explicit SerializedBufferPool(size_t max_cached);
+  ~SerializedBufferPool();
+
+  void ref();
+  void unref();
+
+  void * allocate(size_t size);
+  void deallocate(void * pointer);
+  void * reallocate(void * pointer, size_t size);
+
+  static void * allocate_cb(size_t size, void * state);
+  static void deallocate_cb(void * pointer, void * state);
+  static void * reallocate_cb(void * pointer, size_t size, void * state);
+  static void * zero_allocate_cb(size_t number_of_elements, size_t size_of_element, void * state);
+
+  std::atomic<uint32_t> m_refc;
+  const size_t m_max_cached;
+  std::mutex m_lock;
+  /* unused blocks, each starting with a block header */
+  std::vector<void *> m_free;
+};
+
+#endif  // SERIALIZED_BUFFER_POOL_HPP_
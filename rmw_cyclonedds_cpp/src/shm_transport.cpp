@@ -0,0 +1,399 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "shm_transport.hpp"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "rcutils/logging_macros.h"
+#include "rmw/error_handling.h"
+
+#include "env_flag.hpp"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SHM_SUPPORTED 1
+#else
+#define SHM_SUPPORTED 0
+#endif
+
+/* Number of slots in the ring of a publisher: a subscription that falls behind by more than
+   this many samples loses samples.  Half of it is the maximum history depth of a subscription,
+   the other half is for samples that are still on their way to it. */
+#define SHM_SLOT_COUNT 32
+
+/* Capacity of a slot, larger samples are published over the network as usual.  The memory for
+   all slots is reserved when the segment is created, so a publisher only uses shared memory if
+   /dev/shm has room for SHM_SLOT_COUNT times this */
+#define SHM_SLOT_SIZE (4 * 1024 * 1024)
+
+/* Maximum number of segments of publishers kept mapped by a process, beyond that the one mapped
+   first gets unmapped again (once no one is using it) */
+#define SHM_MAX_MAPPINGS 64
+
+#define SHM_MAGIC 0x53434d52u
+
+/* the sequence numbers are shared between processes, which only works if they are lock-free */
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory requires lock-free 64-bit atomics");
+
+/* encapsulation identifier of a descriptor, taken from the range reserved for vendor-specific
+   representations so that it can never be mistaken for CDR */
+static const unsigned char shm_encoding[2] = {0x80, 0x53};
+
+struct shm_segment_header
+{
+  uint32_t magic;
+  uint32_t nslots;
+  uint64_t slot_size;
+  uint64_t slot_stride;
+};
+
+/* offset of the first slot, each slot starts with the sequence number followed by the data */
+#define SHM_SLOTS_OFFSET 64
+#define SHM_SLOT_DATA_OFFSET 8
+
+/* follows the encapsulation header in the payload of the serdata published over DDS */
+struct shm_descriptor
+{
+  char name[32];
+  uint32_t slot;
+  uint32_t size;
+  uint64_t seq;
+};
+
+struct shm_mapping
+{
+  const void * base;
+  size_t size;
+  ~shm_mapping();
+};
+
+static void * slot_at(void * base, uint64_t stride, uint32_t slot)
+{
+  return static_cast<char *>(base) + SHM_SLOTS_OFFSET + slot * stride;
+}
+
+bool shm_enabled()
+{
+#if SHM_SUPPORTED
+  static const bool enabled = env_flag("RMW_CYCLONEDDS_SHM");
+  return enabled;
+#else
+  return false;
+#endif
+}
+
+const std::string & shm_host_id()
+{
+  /* The boot id distinguishes hosts (and boots); the identity of /dev/shm distinguishes
+     containers that have a private one on the same host; the user id those that can't map
+     each other's segments */
+  static const std::string id = [] {
+      std::string s;
+#if SHM_SUPPORTED
+      char buf[64];
+      FILE * fp;
+      if ((fp = fopen("/proc/sys/kernel/random/boot_id", "r")) != nullptr) {
+        if (fgets(buf, sizeof(buf), fp) != nullptr) {
+          s = std::string(buf, strcspn(buf, "\n"));
+        }
+        fclose(fp);
+      }
+      if (s.empty() && gethostname(buf, sizeof(buf)) == 0) {
+        buf[sizeof(buf) - 1] = 0;
+        s = buf;
+      }
+      struct stat st;
+      if (stat("/dev/shm", &st) == 0) {
+        snprintf(
+          buf, sizeof(buf), "/%" PRIx64 ":%" PRIx64, static_cast<uint64_t>(st.st_dev),
+          static_cast<uint64_t>(st.st_ino));
+        s += buf;
+      }
+      snprintf(buf, sizeof(buf), "/%lu", static_cast<unsigned long>(geteuid()));
+      s += buf;
+#endif
+      return s;
+    } ();
+  return id;
+}
+
+uint32_t shm_max_history_depth()
+{
+  return SHM_SLOT_COUNT / 2;
+}
+
+bool shm_is_descriptor(const void * payload, size_t size)
+{
+  return size == ShmWriter::descriptor_size() && memcmp(payload, shm_encoding, 2) == 0;
+}
+
+#if SHM_SUPPORTED
+shm_mapping::~shm_mapping()
+{
+  munmap(const_cast<void *>(base), size);
+}
+
+static std::shared_ptr<const shm_mapping> map_segment(const char * name)
+{
+  int fd;
+  if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  void * base = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= SHM_SLOTS_OFFSET) {
+    base = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) {
+    return nullptr;
+  }
+  std::shared_ptr<shm_mapping> m;
+  try {
+    m = std::make_shared<shm_mapping>();
+  } catch (std::bad_alloc &) {
+    munmap(base, static_cast<size_t>(st.st_size));
+    return nullptr;
+  }
+  m->base = base;
+  m->size = static_cast<size_t>(st.st_size);
+  auto hdr = static_cast<const shm_segment_header *>(m->base);
+  if (hdr->magic != SHM_MAGIC ||
+    hdr->slot_stride < SHM_SLOT_DATA_OFFSET + hdr->slot_size ||
+    (m->size - SHM_SLOTS_OFFSET) / hdr->slot_stride < hdr->nslots)
+  {
+    return nullptr;
+  }
+  return m;
+}
+
+static std::shared_ptr<const shm_mapping> get_mapping(const char * name)
+{
+  static std::mutex lock;
+  static std::unordered_map<std::string, std::shared_ptr<const shm_mapping>> mappings;
+  std::lock_guard<std::mutex> guard(lock);
+  auto it = mappings.find(name);
+  if (it != mappings.end()) {
+    return it->second;
+  }
+  auto m = map_segment(name);
+  if (m != nullptr) {
+    if (mappings.size() >= SHM_MAX_MAPPINGS) {
+      mappings.erase(mappings.begin());
+    }
+    mappings.emplace(name, m);
+  } else {
+    /* the publisher has no way of knowing, so at least say so (once per segment) rather than
+       having its samples vanish without a trace */
+    static std::unordered_set<std::string> failed;
+    if (failed.size() >= SHM_MAX_MAPPINGS) {
+      failed.clear();
+    }
+    if (failed.insert(name).second) {
+      RCUTILS_LOG_ERROR_NAMED(
+        "rmw_cyclonedds_cpp", "failed to map shared memory segment %s, dropping its samples",
+        name);
+    }
+  }
+  return m;
+}
+
+bool shm_resolve(const void * descriptor, size_t size, shm_sample * sample)
+{
+  shm_descriptor desc;
+  if (!shm_is_descriptor(descriptor, size)) {
+    return false;
+  }
+  memcpy(&desc, static_cast<const char *>(descriptor) + 4, sizeof(desc));
+  desc.name[sizeof(desc.name) - 1] = 0;
+  auto m = get_mapping(desc.name);
+  if (m == nullptr) {
+    return false;
+  }
+  auto hdr = static_cast<const shm_segment_header *>(m->base);
+  if (desc.slot >= hdr->nslots || desc.size > hdr->slot_size) {
+    return false;
+  }
+  const void * slot = slot_at(const_cast<void *>(m->base), hdr->slot_stride, desc.slot);
+  sample->seqp = static_cast<const std::atomic<uint64_t> *>(slot);
+  if ((sample->seq = sample->seqp->load(std::memory_order_acquire)) != desc.seq) {
+    return false;
+  }
+  sample->data = static_cast<const char *>(slot) + SHM_SLOT_DATA_OFFSET;
+  sample->size = desc.size;
+  sample->mapping = std::move(m);
+  return true;
+}
+
+bool shm_sample_intact(const shm_sample & sample)
+{
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return sample.seqp->load(std::memory_order_relaxed) == sample.seq;
+}
+
+std::unique_ptr<ShmWriter> ShmWriter::create(uint64_t unique_id)
+{
+  std::unique_ptr<ShmWriter> w(new ShmWriter());
+  char name[sizeof(shm_descriptor::name)];
+  snprintf(name, sizeof(name), "/rmw_cdds_%016" PRIx64, unique_id);
+  w->m_name = name;
+  w->m_nslots = SHM_SLOT_COUNT;
+  w->m_slot_size = SHM_SLOT_SIZE;
+  const uint64_t stride = (SHM_SLOT_DATA_OFFSET + w->m_slot_size + 63) & ~uint64_t(63);
+  w->m_mapsize = SHM_SLOTS_OFFSET + w->m_nslots * stride;
+
+  int fd;
+  if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+    RMW_SET_ERROR_MSG("failed to create shared memory segment");
+    return nullptr;
+  }
+  /* a sparse segment would get its pages on first write, and writing to a page that can't be
+     allocated because /dev/shm is full raises SIGBUS, so reserve them all now */
+  int err;
+  if (ftruncate(fd, static_cast<off_t>(w->m_mapsize)) != 0) {
+    err = errno;
+  } else {
+#if defined(__linux__)
+    err = posix_fallocate(fd, 0, static_cast<off_t>(w->m_mapsize));
+#else
+    err = 0;
+#endif
+  }
+  if (err != 0) {
+    close(fd);
+    shm_unlink(name);
+    RMW_SET_ERROR_MSG("failed to allocate shared memory segment");
+    return nullptr;
+  }
+  void * base = mmap(nullptr, w->m_mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(name);
+    RMW_SET_ERROR_MSG("failed to map shared memory segment");
+    return nullptr;
+  }
+  w->m_base = base;
+  for (uint32_t i = 0; i < w->m_nslots; i++) {
+    new (slot_at(base, stride, i)) std::atomic<uint64_t>(0);
+  }
+  auto hdr = static_cast<shm_segment_header *>(base);
+  hdr->nslots = w->m_nslots;
+  hdr->slot_size = w->m_slot_size;
+  hdr->slot_stride = stride;
+  std::atomic_thread_fence(std::memory_order_release);
+  hdr->magic = SHM_MAGIC;
+  return w;
+}
+
+ShmWriter::~ShmWriter()
+{
+  /* subscriptions that have it mapped keep it until they unmap it, but can't map it anew */
+  munmap(m_base, m_mapsize);
+  shm_unlink(m_name.c_str());
+}
+
+void * ShmWriter::begin_write(size_t size)
+{
+  if (size > m_slot_size) {
+    return nullptr;
+  }
+  auto hdr = static_cast<shm_segment_header *>(m_base);
+  m_cur = m_next;
+  m_cur_size = size;
+  m_next = (m_next + 1) % m_nslots;
+  void * slot = slot_at(m_base, hdr->slot_stride, m_cur);
+  auto seqp = static_cast<std::atomic<uint64_t> *>(slot);
+  /* odd while writing */
+  seqp->store(seqp->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return static_cast<char *>(slot) + SHM_SLOT_DATA_OFFSET;
+}
+
+void ShmWriter::end_write(void * descriptor)
+{
+  auto hdr = static_cast<shm_segment_header *>(m_base);
+  auto seqp = static_cast<std::atomic<uint64_t> *>(slot_at(m_base, hdr->slot_stride, m_cur));
+  const uint64_t seq = seqp->load(std::memory_order_relaxed) + 1;
+  seqp->store(seq, std::memory_order_release);
+  if (descriptor != nullptr) {
+    shm_descriptor desc;
+    memset(&desc, 0, sizeof(desc));
+    memcpy(desc.name, m_name.c_str(), m_name.size() + 1);
+    desc.slot = m_cur;
+    desc.size = static_cast<uint32_t>(m_cur_size);
+    desc.seq = seq;
+    auto dst = static_cast<unsigned char *>(descriptor);
+    dst[0] = shm_encoding[0];
+    dst[1] = shm_encoding[1];
+    dst[2] = dst[3] = 0;
+    memcpy(dst + 4, &desc, sizeof(desc));
+  }
+}
+#else
+shm_mapping::~shm_mapping()
+{
+}
+
+bool shm_resolve(const void * descriptor, size_t size, shm_sample * sample)
+{
+  static_cast<void>(descriptor);
+  static_cast<void>(size);
+  static_cast<void>(sample);
+  return false;
+}
+
+bool shm_sample_intact(const shm_sample & sample)
+{
+  static_cast<void>(sample);
+  return false;
+}
+
+std::unique_ptr<ShmWriter> ShmWriter::create(uint64_t unique_id)
+{
+  static_cast<void>(unique_id);
+  RMW_SET_ERROR_MSG("shared memory not supported on this platform");
+  return nullptr;
+}
+
+ShmWriter::~ShmWriter()
+{
+}
+
+void * ShmWriter::begin_write(size_t size)
+{
+  static_cast<void>(size);
+  return nullptr;
+}
+
+void ShmWriter::end_write(void * descriptor)
+{
+  static_cast<void>(descriptor);
+}
+#endif
+
+size_t ShmWriter::descriptor_size()
+{
+  return 4 + sizeof(shm_descriptor);
+}
@@ -0,0 +1,123 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef SHM_TRANSPORT_HPP_
+#define SHM_TRANSPORT_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/* Same-host data path through POSIX shared memory.
+
+   A publisher serializes samples into a ring of slots in a shared-memory segment of its own and
+   publishes only a small descriptor naming the segment, the slot and the slot's sequence number
+   over DDS.  A subscription maps the segment (read-only) on first use and deserializes straight
+   from the slot.  Slots are protected by a sequence lock: the writer makes the sequence number
+   odd while it writes a slot, and the reader checks it is unchanged after using the data, so a
+   sample that got overwritten because the reader fell behind by more than the ring size is
+   detected and dropped rather than delivered corrupted.
+
+   It is opt-in (set RMW_CYCLONEDDS_SHM=1 in all processes involved).  Subscriptions whose
+   history can't outgrow the ring advertise the host and user they run as in the user data of
+   the reader QoS, and a publisher only uses shared memory while all matched subscriptions
+   advertise the same as its own.  That way a reliable subscription never has a sample in its
+   history that the ring no longer holds, unless it falls behind on receiving, and a segment is
+   never published to a process that isn't allowed to map it. */
+
+struct shm_mapping;
+
+/* Whether the shared-memory data path is enabled in this process */
+bool shm_enabled();
+
+/* Identifies this host and the user this process runs as, two processes can share memory if
+   their identifiers are equal (segments are accessible to their owner only) */
+const std::string & shm_host_id();
+
+/* Largest KEEP_LAST depth of the history of a subscription reading from shared memory, a deeper
+   history (or KEEP_ALL) could hold descriptors of samples that have since been overwritten */
+uint32_t shm_max_history_depth();
+
+/* A reference to a serialized sample in a segment of another (or the same) process, it may get
+   overwritten at any moment; valid until shm_sample_intact returns false */
+struct shm_sample
+{
+  std::shared_ptr<const shm_mapping> mapping;
+  const void * data;
+  size_t size;
+  const std::atomic<uint64_t> * seqp;
+  uint64_t seq;
+};
+
+/* True if the payload is a shared-memory descriptor rather than a serialized sample */
+bool shm_is_descriptor(const void * payload, size_t size);
+
+/* Locates the sample a descriptor refers to, mapping the segment if necessary.  Returns false if
+   the segment can't be mapped or the sample has already been overwritten */
+bool shm_resolve(const void * descriptor, size_t size, shm_sample * sample);
+
+/* True if the sample hasn't been touched by the writer since it was resolved */
+bool shm_sample_intact(const shm_sample & sample);
+
+/* Calls f with the serialized sample a descriptor refers to, returning true if f returned true
+   and the data it was given was intact throughout */
+template<typename Func>
+bool shm_with_sample(const void * descriptor, size_t size, Func f)
+{
+  shm_sample sample;
+  if (!shm_resolve(descriptor, size, &sample)) {
+    return false;
+  }
+  const bool ok = f(sample.data, sample.size);
+  return shm_sample_intact(sample) && ok;
+}
+
+/* The ring of slots of a single publisher, the segment is removed when it is destroyed.  Not
+   thread-safe, the caller must serialize calls to begin_write and end_write */
+class ShmWriter
+{
+public:
+  /* Creates the segment, returns null (and sets the error message) if that fails */
+  static std::unique_ptr<ShmWriter> create(uint64_t unique_id);
+  ~ShmWriter();
+  ShmWriter(const ShmWriter &) = delete;
+  ShmWriter & operator=(const ShmWriter &) = delete;
+
+  /* size of the descriptor written by end_write */
+  static size_t descriptor_size();
+
+  /* Claims the oldest slot for a serialized sample of size bytes and returns a pointer to where
+     it must be written, or null if it is too large to fit in a slot */
+  void * begin_write(size_t size);
+  /* Completes the write started by begin_write; if descriptor is non-null, it gets the
+     descriptor_size() bytes of descriptor (including encapsulation header) for the sample,
+     null is for abandoning a write */
+  void end_write(void * descriptor);
+
+private:
+  ShmWriter() = default;
+
+  std::string m_name;
+  void * m_base {nullptr};
+  size_t m_mapsize {0};
+  uint32_t m_nslots {0};
+  size_t m_slot_size {0};
+  uint32_t m_next {0};
+  /* slot and size of the write in progress */
+  uint32_t m_cur {0};
+  size_t m_cur_size {0};
+};
+
+#endif  // SHM_TRANSPORT_HPP_
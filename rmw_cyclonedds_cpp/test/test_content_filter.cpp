@@ -0,0 +1,441 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ContentFilter.hpp"
+#include "Serialization.hpp"
+#include "TypeSupport2.hpp"
+#include "rosidl_runtime_c/message_type_support_struct.h"
+#include "rosidl_runtime_c/primitives_sequence.h"
+#include "rosidl_runtime_c/string.h"
+#include "rosidl_typesupport_introspection_c/field_types.h"
+#include "rosidl_typesupport_introspection_c/identifier.h"
+#include "rosidl_typesupport_introspection_c/message_introspection.h"
+
+using rmw_cyclonedds_cpp::BaseCDRWriter;
+using rmw_cyclonedds_cpp::ContentFilter;
+using rmw_cyclonedds_cpp::make_cdr_writer;
+using rmw_cyclonedds_cpp::make_message_value_type;
+
+namespace
+{
+
+// Hand-written equivalents of what rosidl generates for the C introspection type support of
+//
+//   Inner.msg:   string label, float64 x
+//   Sample.msg:  bool flag, int8 i8, uint32 u32, int64 i64, uint64 u64, float32 f32,
+//                string name, Inner inner, int16 after, int32[] values, float64[3] arr,
+//                Inner[] items
+//   Plain.msg:   int8 a, uint16 b, uint32 c, int64 d, float64 e
+
+struct Inner
+{
+  rosidl_runtime_c__String label;
+  double x;
+};
+
+struct InnerSequence
+{
+  Inner * data;
+  size_t size;
+  size_t capacity;
+};
+
+struct Sample
+{
+  bool flag;
+  int8_t i8;
+  uint32_t u32;
+  int64_t i64;
+  uint64_t u64;
+  float f32;
+  rosidl_runtime_c__String name;
+  Inner inner;
+  int16_t after;
+  rosidl_runtime_c__int32__Sequence values;
+  double arr[3];
+  InnerSequence items;
+};
+
+struct Plain
+{
+  int8_t a;
+  uint16_t b;
+  uint32_t c;
+  int64_t d;
+  double e;
+};
+
+const rosidl_message_type_support_t * get_handle(
+  const rosidl_message_type_support_t * handle, const char * identifier)
+{
+  if (std::strcmp(handle->typesupport_identifier, identifier) == 0) {
+    return handle;
+  }
+  return nullptr;
+}
+
+rosidl_typesupport_introspection_c__MessageMember member(
+  const char * name, uint8_t type_id, size_t offset,
+  const rosidl_message_type_support_t * members = nullptr)
+{
+  rosidl_typesupport_introspection_c__MessageMember m{};
+  m.name_ = name;
+  m.type_id_ = type_id;
+  m.members_ = members;
+  m.offset_ = static_cast<uint32_t>(offset);
+  return m;
+}
+
+rosidl_typesupport_introspection_c__MessageMember array_member(
+  rosidl_typesupport_introspection_c__MessageMember m, size_t array_size)
+{
+  m.is_array_ = true;
+  m.array_size_ = array_size;
+  return m;
+}
+
+template<size_t N>
+rosidl_typesupport_introspection_c__MessageMembers members_of(
+  const char * name, size_t size_of,
+  const rosidl_typesupport_introspection_c__MessageMember (&members)[N])
+{
+  rosidl_typesupport_introspection_c__MessageMembers m{};
+  m.message_namespace_ = "test_msgs__msg";
+  m.message_name_ = name;
+  m.member_count_ = static_cast<uint32_t>(N);
+  m.size_of_ = size_of;
+  m.members_ = members;
+  return m;
+}
+
+const rosidl_message_type_support_t * inner_type_support()
+{
+  static const rosidl_typesupport_introspection_c__MessageMember members[] = {
+    member("label", rosidl_typesupport_introspection_c__ROS_TYPE_STRING, offsetof(Inner, label)),
+    member("x", rosidl_typesupport_introspection_c__ROS_TYPE_DOUBLE, offsetof(Inner, x)),
+  };
+  static const auto message_members = members_of("Inner", sizeof(Inner), members);
+  static const rosidl_message_type_support_t handle = {
+    rosidl_typesupport_introspection_c__identifier, &message_members, get_handle};
+  return &handle;
+}
+
+const rosidl_message_type_support_t * sample_type_support()
+{
+  static const rosidl_typesupport_introspection_c__MessageMember members[] = {
+    member("flag", rosidl_typesupport_introspection_c__ROS_TYPE_BOOLEAN, offsetof(Sample, flag)),
+    member("i8", rosidl_typesupport_introspection_c__ROS_TYPE_INT8, offsetof(Sample, i8)),
+    member("u32", rosidl_typesupport_introspection_c__ROS_TYPE_UINT32, offsetof(Sample, u32)),
+    member("i64", rosidl_typesupport_introspection_c__ROS_TYPE_INT64, offsetof(Sample, i64)),
+    member("u64", rosidl_typesupport_introspection_c__ROS_TYPE_UINT64, offsetof(Sample, u64)),
+    member("f32", rosidl_typesupport_introspection_c__ROS_TYPE_FLOAT, offsetof(Sample, f32)),
+    member("name", rosidl_typesupport_introspection_c__ROS_TYPE_STRING, offsetof(Sample, name)),
+    member(
+      "inner", rosidl_typesupport_introspection_c__ROS_TYPE_MESSAGE, offsetof(Sample, inner),
+      inner_type_support()),
+    member("after", rosidl_typesupport_introspection_c__ROS_TYPE_INT16, offsetof(Sample, after)),
+    array_member(
+      member(
+        "values", rosidl_typesupport_introspection_c__ROS_TYPE_INT32, offsetof(Sample, values)),
+      0),
+    array_member(
+      member("arr", rosidl_typesupport_introspection_c__ROS_TYPE_DOUBLE, offsetof(Sample, arr)),
+      3),
+    array_member(
+      member(
+        "items", rosidl_typesupport_introspection_c__ROS_TYPE_MESSAGE, offsetof(Sample, items),
+        inner_type_support()),
+      0),
+  };
+  static const auto message_members = members_of("Sample", sizeof(Sample), members);
+  static const rosidl_message_type_support_t handle = {
+    rosidl_typesupport_introspection_c__identifier, &message_members, get_handle};
+  return &handle;
+}
+
+const rosidl_message_type_support_t * plain_type_support()
+{
+  static const rosidl_typesupport_introspection_c__MessageMember members[] = {
+    member("a", rosidl_typesupport_introspection_c__ROS_TYPE_INT8, offsetof(Plain, a)),
+    member("b", rosidl_typesupport_introspection_c__ROS_TYPE_UINT16, offsetof(Plain, b)),
+    member("c", rosidl_typesupport_introspection_c__ROS_TYPE_UINT32, offsetof(Plain, c)),
+    member("d", rosidl_typesupport_introspection_c__ROS_TYPE_INT64, offsetof(Plain, d)),
+    member("e", rosidl_typesupport_introspection_c__ROS_TYPE_DOUBLE, offsetof(Plain, e)),
+  };
+  static const auto message_members = members_of("Plain", sizeof(Plain), members);
+  static const rosidl_message_type_support_t handle = {
+    rosidl_typesupport_introspection_c__identifier, &message_members, get_handle};
+  return &handle;
+}
+
+// The strings only need to outlive serialization, so they point at literals
+rosidl_runtime_c__String make_string(const char * s)
+{
+  rosidl_runtime_c__String str;
+  str.data = const_cast<char *>(s);
+  str.size = std::strlen(s);
+  str.capacity = str.size + 1;
+  return str;
+}
+
+class ContentFilterTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    sample_writer = make_cdr_writer(make_message_value_type(sample_type_support()));
+    plain_writer = make_cdr_writer(make_message_value_type(plain_type_support()));
+
+    values = {10, -20, 30};
+    items[0] = {make_string("first item with a long label"), 1.5};
+    items[1] = {make_string("2nd"), -2.5};
+
+    sample.flag = true;
+    sample.i8 = -7;
+    sample.u32 = 4000000000u;
+    sample.i64 = -5000000000;
+    sample.u64 = std::numeric_limits<uint64_t>::max();
+    sample.f32 = 0.25f;
+    sample.name = make_string("it's");
+    sample.inner = {make_string("abcde"), 3.75};
+    sample.after = -300;
+    sample.values = {values.data(), values.size(), values.size()};
+    sample.arr[0] = 0.5;
+    sample.arr[1] = 1.5;
+    sample.arr[2] = 2.5;
+    sample.items = {items, 2, 2};
+  }
+
+  static std::vector<unsigned char> serialize(const BaseCDRWriter & writer, const void * msg)
+  {
+    std::vector<unsigned char> buf(writer.get_serialized_size(msg));
+    writer.serialize(buf.data(), msg);
+    return buf;
+  }
+
+  static std::unique_ptr<ContentFilter> compile(
+    const BaseCDRWriter & writer, const std::string & expression,
+    const std::vector<std::string> & parameters = {})
+  {
+    return ContentFilter::compile(writer.value_type(), expression, parameters);
+  }
+
+  bool matches(const std::string & expression, const std::vector<std::string> & parameters = {})
+  {
+    auto buf = serialize(*sample_writer, &sample);
+    return compile(*sample_writer, expression, parameters)->matches(buf.data(), buf.size());
+  }
+
+  std::unique_ptr<BaseCDRWriter> sample_writer;
+  std::unique_ptr<BaseCDRWriter> plain_writer;
+  std::vector<int32_t> values;
+  Inner items[2];
+  Sample sample{};
+};
+
+TEST_F(ContentFilterTest, tokenizer) {
+  EXPECT_TRUE(matches("i8=-7"));
+  EXPECT_TRUE(matches("i8<>-6AND(after<0)"));
+  EXPECT_TRUE(matches("  i8 = -7\tand\nnot flag = false  "));
+  EXPECT_TRUE(matches("i8 == -7 Or FALSE = TRUE"));
+  EXPECT_TRUE(matches("i8 != 7"));
+  EXPECT_TRUE(matches("TRUE = true"));
+  EXPECT_FALSE(matches("false = TRUE"));
+  EXPECT_TRUE(matches("name = 'it''s'"));
+  EXPECT_FALSE(matches("name = 'its'"));
+  EXPECT_TRUE(matches("inner.label = 'abcde'"));
+  EXPECT_TRUE(matches("f32 = 2.5e-1"));
+  EXPECT_TRUE(matches("f32 < 25E-2 OR f32 > 0.24"));
+
+  const char * malformed[] = {
+    "",
+    "i8",
+    "TRUE",
+    "i8 =",
+    "= -7",
+    "i8 = -7 AND",
+    "(i8 = -7",
+    "i8 = -7)",
+    "i8 = -7 i8 = -7",
+    "i8 # -7",
+    "i8 = 'unterminated",
+    "i8 =< -7",
+    "i8 = %",
+    "i8 = %0",
+    "name = 1",
+    "i8 = 'x'",
+    "nosuchfield = 1",
+    "inner = 1",
+    "inner.nosuchfield = 1",
+    "i8.x = 1",
+    "values = 1",
+    "arr[3] = 1",
+    "arr[] = 1",
+    "arr[-1] = 1",
+  };
+  for (auto expression : malformed) {
+    EXPECT_THROW(compile(*sample_writer, expression), std::invalid_argument) << expression;
+  }
+}
+
+TEST_F(ContentFilterTest, parameters) {
+  EXPECT_TRUE(matches("i8 = %0 AND name = %1", {"-7", "'it''s'"}));
+  EXPECT_TRUE(matches("name = %0", {"it's"}));
+  EXPECT_FALSE(matches("i8 = %1", {"-7", "7"}));
+  EXPECT_TRUE(matches("%0 > u32", {"4000000001"}));
+  EXPECT_THROW(compile(*sample_writer, "i8 = %1", {"-7"}), std::invalid_argument);
+}
+
+TEST_F(ContentFilterTest, signed_unsigned_comparison) {
+  // An unsigned field compared with a negative literal mustn't wrap around
+  EXPECT_TRUE(matches("u32 > -1"));
+  EXPECT_TRUE(matches("u32 = 4000000000"));
+  EXPECT_TRUE(matches("u32 > 2147483647"));
+  EXPECT_FALSE(matches("u32 < 0"));
+  EXPECT_TRUE(matches("u64 = 18446744073709551615"));
+  EXPECT_TRUE(matches("u64 > 9223372036854775807"));
+  EXPECT_TRUE(matches("u64 > -9223372036854775808"));
+  EXPECT_FALSE(matches("u64 <= i64"));
+  EXPECT_TRUE(matches("i64 < u32"));
+  EXPECT_TRUE(matches("i64 < 18446744073709551615"));
+  EXPECT_TRUE(matches("i64 = -5000000000"));
+  EXPECT_TRUE(matches("i8 < u32 AND u32 > i8"));
+  EXPECT_TRUE(matches("after < 0 AND after > -301 AND after >= -300"));
+
+  sample.i64 = std::numeric_limits<int64_t>::min();
+  EXPECT_TRUE(matches("i64 = -9223372036854775808"));
+  EXPECT_TRUE(matches("i64 < u64"));
+  EXPECT_FALSE(matches("i64 > 0"));
+}
+
+TEST_F(ContentFilterTest, floating_point_and_booleans) {
+  EXPECT_TRUE(matches("f32 = 0.25 AND f32 < 1 AND f32 > i8"));
+  EXPECT_TRUE(matches("inner.x > 3 AND inner.x < 4"));
+  EXPECT_TRUE(matches("flag = TRUE AND flag <> FALSE"));
+
+  sample.f32 = std::numeric_limits<float>::quiet_NaN();
+  EXPECT_FALSE(matches("f32 = f32"));
+  EXPECT_FALSE(matches("f32 < 0 OR f32 >= 0"));
+}
+
+TEST_F(ContentFilterTest, arrays_and_sequences) {
+  EXPECT_TRUE(matches("arr[0] = 0.5 AND arr[1] = 1.5 AND arr[2] = 2.5"));
+  EXPECT_TRUE(matches("values[0] = 10 AND values[1] = -20 AND values[2] = 30"));
+  EXPECT_TRUE(matches("items[0].x = 1.5 AND items[1].x = -2.5"));
+  EXPECT_TRUE(matches("items[1].label = '2nd'"));
+}
+
+TEST_F(ContentFilterTest, sequence_index_past_the_end) {
+  EXPECT_FALSE(matches("values[3] = 0"));
+  EXPECT_FALSE(matches("values[3] <> 0"));
+  EXPECT_TRUE(matches("NOT values[3] = 0"));
+  EXPECT_TRUE(matches("values[3] = 0 OR values[2] = 30"));
+  EXPECT_FALSE(matches("items[2].x = 0"));
+  EXPECT_FALSE(matches("items[1000000].label = ''"));
+
+  sample.values.size = 0;
+  sample.items.size = 0;
+  EXPECT_FALSE(matches("values[0] = 10"));
+  EXPECT_FALSE(matches("items[0].x = 1.5"));
+  // The fields after the empty sequences are still found
+  EXPECT_TRUE(matches("arr[2] = 2.5"));
+}
+
+TEST_F(ContentFilterTest, alignment_after_strings) {
+  // Every length modulo 8 puts the fields after the strings at a different offset from their
+  // alignment
+  const char * labels[] = {"", "a", "ab", "abc", "abcd", "abcde", "abcdef", "abcdefg"};
+  for (auto name : labels) {
+    for (auto label : labels) {
+      sample.name = make_string(name);
+      sample.inner.label = make_string(label);
+      items[0].label = make_string(label);
+      EXPECT_TRUE(
+        matches(
+          "name = %0 AND inner.label = %1 AND inner.x = 3.75 AND after = -300 AND "
+          "values[1] = -20 AND arr[2] = 2.5 AND items[0].x = 1.5 AND items[1].x = -2.5",
+          {std::string("'") + name + "'", std::string("'") + label + "'"}))
+        << "name '" << name << "', label '" << label << "'";
+    }
+  }
+}
+
+TEST_F(ContentFilterTest, byte_swapped_payload) {
+  Plain plain{-3, 0x1234, 0x89abcdefu, -0x0102030405060708, -1.25};
+  auto native = serialize(*plain_writer, &plain);
+
+  // Hand-encode the same message in the other byte order
+  bool native_little = native[1] == 1;
+  std::vector<unsigned char> swapped(4, 0);
+  swapped[1] = native_little ? 0 : 1;
+  auto put = [&swapped](const void * value, size_t size) {
+      while ((swapped.size() - 4) % size != 0) {
+        swapped.push_back(0);
+      }
+      auto bytes = static_cast<const unsigned char *>(value);
+      for (size_t i = size; i-- > 0; ) {
+        swapped.push_back(bytes[i]);
+      }
+    };
+  put(&plain.a, sizeof(plain.a));
+  put(&plain.b, sizeof(plain.b));
+  put(&plain.c, sizeof(plain.c));
+  put(&plain.d, sizeof(plain.d));
+  put(&plain.e, sizeof(plain.e));
+  ASSERT_EQ(native.size(), swapped.size());
+  ASSERT_NE(native, swapped);
+
+  const char * expressions[] = {
+    "a = -3", "b = 4660", "c = 2309737967", "d = -72623859790382856", "e = -1.25",
+    "c > b AND d < a AND e < 0"};
+  for (auto expression : expressions) {
+    auto filter = compile(*plain_writer, expression);
+    EXPECT_TRUE(filter->matches(native.data(), native.size())) << expression;
+    EXPECT_TRUE(filter->matches(swapped.data(), swapped.size())) << expression;
+  }
+  auto filter = compile(*plain_writer, "c = 4023233417");
+  EXPECT_FALSE(filter->matches(swapped.data(), swapped.size()));
+}
+
+TEST_F(ContentFilterTest, malformed_payload) {
+  auto buf = serialize(*sample_writer, &sample);
+  auto filter = compile(*sample_writer, "items[1].x = -2.5");
+  ASSERT_TRUE(filter->matches(buf.data(), buf.size()));
+
+  // Truncated anywhere, the message doesn't pass
+  for (size_t size = 0; size < buf.size(); size++) {
+    std::vector<unsigned char> truncated(buf.begin(), buf.begin() + size);
+    EXPECT_FALSE(filter->matches(truncated.data(), truncated.size())) << size;
+  }
+
+  // Nor does one with an encapsulation other than plain CDR
+  auto other = buf;
+  other[1] = 2;
+  EXPECT_FALSE(filter->matches(other.data(), other.size()));
+  other = buf;
+  other[0] = 1;
+  EXPECT_FALSE(filter->matches(other.data(), other.size()));
+}
+
+}  // namespace
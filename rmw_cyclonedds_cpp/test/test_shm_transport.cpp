@@ -0,0 +1,250 @@
+// Copyright 2026 Rover Robotics
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <spawn.h>
+#include <sys/statvfs.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "rcutils/allocator.h"
+#include "rcutils/strdup.h"
+#include "rmw/error_handling.h"
+#include "rmw/init.h"
+#include "rmw/init_options.h"
+#include "rmw/rmw.h"
+#include "rosidl_runtime_c/message_type_support_struct.h"
+#include "rosidl_typesupport_introspection_c/field_types.h"
+#include "rosidl_typesupport_introspection_c/identifier.h"
+#include "rosidl_typesupport_introspection_c/message_introspection.h"
+
+extern char ** environ;
+
+namespace
+{
+
+// The publisher runs in a child process: this binary again, running only the disabled test
+// below, with the topic passed in through the environment
+const char topic_env[] = "RMW_CYCLONEDDS_TEST_SHM_TOPIC";
+const int sample_count = 200;
+const auto timeout = std::chrono::seconds(20);
+
+// The equivalent of what rosidl generates for the C introspection type support of
+//
+//   ShmSample.msg:  uint64 seq, uint8[4096] data
+struct ShmSample
+{
+  uint64_t seq;
+  uint8_t data[4096];
+};
+
+const rosidl_message_type_support_t * get_handle(
+  const rosidl_message_type_support_t * handle, const char * identifier)
+{
+  if (std::strcmp(handle->typesupport_identifier, identifier) == 0) {
+    return handle;
+  }
+  return nullptr;
+}
+
+void init_sample(void * msg, enum rosidl_runtime_c__message_initialization)
+{
+  std::memset(msg, 0, sizeof(ShmSample));
+}
+
+void fini_sample(void *)
+{
+}
+
+const rosidl_message_type_support_t * sample_type_support()
+{
+  static rosidl_typesupport_introspection_c__MessageMember members[2];
+  static rosidl_typesupport_introspection_c__MessageMembers message_members;
+  static const rosidl_message_type_support_t handle = [] {
+      members[0].name_ = "seq";
+      members[0].type_id_ = rosidl_typesupport_introspection_c__ROS_TYPE_UINT64;
+      members[0].offset_ = offsetof(ShmSample, seq);
+      members[1].name_ = "data";
+      members[1].type_id_ = rosidl_typesupport_introspection_c__ROS_TYPE_UINT8;
+      members[1].is_array_ = true;
+      members[1].array_size_ = sizeof(ShmSample::data);
+      members[1].offset_ = offsetof(ShmSample, data);
+      message_members.message_namespace_ = "test_msgs__msg";
+      message_members.message_name_ = "ShmSample";
+      message_members.member_count_ = 2;
+      message_members.size_of_ = sizeof(ShmSample);
+      message_members.members_ = members;
+      message_members.init_function = init_sample;
+      message_members.fini_function = fini_sample;
+      return rosidl_message_type_support_t {
+        rosidl_typesupport_introspection_c__identifier, &message_members, get_handle};
+    } ();
+  return &handle;
+}
+
+uint8_t pattern(uint64_t seq, size_t i)
+{
+  return static_cast<uint8_t>(seq * 31 + i);
+}
+
+// Number of shared-memory segments of publishers in this host's (or container's) /dev/shm
+int count_segments()
+{
+  int n = 0;
+  if (DIR * dir = opendir("/dev/shm")) {
+    while (struct dirent * ent = readdir(dir)) {
+      n += (std::strncmp(ent->d_name, "rmw_cdds_", 9) == 0);
+    }
+    closedir(dir);
+  }
+  return n;
+}
+
+class Node
+{
+public:
+  Node()
+  {
+    rcutils_allocator_t allocator = rcutils_get_default_allocator();
+    EXPECT_EQ(RMW_RET_OK, rmw_init_options_init(&init_options, allocator));
+    init_options.enclave = rcutils_strdup("/", allocator);
+    EXPECT_EQ(RMW_RET_OK, rmw_init(&init_options, &context)) << rmw_get_error_string().str;
+    node = rmw_create_node(&context, "test_shm_transport", "/", 0, false);
+    EXPECT_NE(nullptr, node) << rmw_get_error_string().str;
+  }
+
+  ~Node()
+  {
+    if (node != nullptr) {
+      EXPECT_EQ(RMW_RET_OK, rmw_destroy_node(node));
+    }
+    EXPECT_EQ(RMW_RET_OK, rmw_shutdown(&context));
+    EXPECT_EQ(RMW_RET_OK, rmw_context_fini(&context));
+    EXPECT_EQ(RMW_RET_OK, rmw_init_options_fini(&init_options));
+  }
+
+  rmw_init_options_t init_options = rmw_get_zero_initialized_init_options();
+  rmw_context_t context = rmw_get_zero_initialized_context();
+  rmw_node_t * node {nullptr};
+};
+
+TEST(ShmTransport, DISABLED_publisher) {
+  const char * topic = std::getenv(topic_env);
+  ASSERT_NE(nullptr, topic);
+  Node n;
+  ASSERT_NE(nullptr, n.node);
+  rmw_publisher_options_t options = rmw_get_default_publisher_options();
+  rmw_publisher_t * pub = rmw_create_publisher(
+    n.node, sample_type_support(), topic, &rmw_qos_profile_default, &options);
+  ASSERT_NE(nullptr, pub) << rmw_get_error_string().str;
+
+  const int segments_before = count_segments();
+  size_t matched = 0;
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (matched == 0 && std::chrono::steady_clock::now() < deadline) {
+    ASSERT_EQ(RMW_RET_OK, rmw_publisher_count_matched_subscriptions(pub, &matched));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(1u, matched);
+
+  ShmSample msg;
+  for (int seq = 0; seq < sample_count; seq++) {
+    msg.seq = static_cast<uint64_t>(seq);
+    for (size_t i = 0; i < sizeof(msg.data); i++) {
+      msg.data[i] = pattern(msg.seq, i);
+    }
+    ASSERT_EQ(RMW_RET_OK, rmw_publish(pub, &msg, nullptr)) << rmw_get_error_string().str;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  // The samples went through a segment of this publisher's
+  EXPECT_EQ(segments_before + 1, count_segments());
+
+  // Deleting the publisher would remove the segment, so wait for the subscription to be done
+  while (matched != 0 && std::chrono::steady_clock::now() < deadline) {
+    ASSERT_EQ(RMW_RET_OK, rmw_publisher_count_matched_subscriptions(pub, &matched));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(RMW_RET_OK, rmw_destroy_publisher(n.node, pub));
+}
+
+TEST(ShmTransport, two_processes) {
+  // The publisher reserves its whole segment of 32 slots of 4 MiB up front and falls back to
+  // CDR if /dev/shm can't hold it
+  struct statvfs st;
+  if (statvfs("/dev/shm", &st) != 0 ||
+    static_cast<uint64_t>(st.f_bavail) * st.f_frsize < 160u * 1024 * 1024)
+  {
+    std::cout << "not enough room in /dev/shm, skipping" << std::endl;
+    return;
+  }
+
+  // The publisher inherits the environment, and both must have it set before the RMW layer
+  // first looks at it
+  ASSERT_EQ(0, setenv("RMW_CYCLONEDDS_SHM", "1", 1));
+  const std::string topic = "/test_shm_transport_" + std::to_string(getpid());
+  Node n;
+  ASSERT_NE(nullptr, n.node);
+  rmw_subscription_options_t options = rmw_get_default_subscription_options();
+  rmw_subscription_t * sub = rmw_create_subscription(
+    n.node, sample_type_support(), topic.c_str(), &rmw_qos_profile_default, &options);
+  ASSERT_NE(nullptr, sub) << rmw_get_error_string().str;
+
+  ASSERT_EQ(0, setenv(topic_env, topic.c_str(), 1));
+  char filter[] = "--gtest_filter=ShmTransport.DISABLED_publisher";
+  char also_disabled[] = "--gtest_also_run_disabled_tests";
+  char exe[] = "/proc/self/exe";
+  char * argv[] = {exe, filter, also_disabled, nullptr};
+  pid_t pid;
+  ASSERT_EQ(0, posix_spawn(&pid, exe, nullptr, nullptr, argv, environ));
+
+  // Samples may get lost when this falls behind by more than the ring size, but whatever is
+  // received must be intact and the last one always arrives
+  ShmSample msg;
+  int received = 0;
+  int64_t last = -1;
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (last < sample_count - 1 && std::chrono::steady_clock::now() < deadline) {
+    bool taken = false;
+    ASSERT_EQ(RMW_RET_OK, rmw_take(sub, &msg, &taken, nullptr));
+    if (!taken) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    ASSERT_GT(static_cast<int64_t>(msg.seq), last);
+    for (size_t i = 0; i < sizeof(msg.data); i++) {
+      ASSERT_EQ(pattern(msg.seq, i), msg.data[i]) << "seq " << msg.seq << " index " << i;
+    }
+    last = static_cast<int64_t>(msg.seq);
+    received++;
+  }
+  EXPECT_EQ(sample_count - 1, last);
+  EXPECT_GT(received, sample_count / 2);
+  EXPECT_EQ(RMW_RET_OK, rmw_destroy_subscription(n.node, sub));
+
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0) << "publisher failed";
+}
+
+}  // namespace